@@ -0,0 +1,405 @@
+#include "ace_env.h"
+#include "fork.h"
+#include "interpreter.h"
+#include "random.h"
+#include "registers.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <spdlog/spdlog.h>
+#include <string>
+#include <tl/expected.hpp>
+#include <vector>
+
+static_assert(ACE_ENV_SCREEN_WIDTH == kScreenWidth &&
+                  ACE_ENV_SCREEN_HEIGHT == kScreenHeight &&
+                  ACE_ENV_MEMORY_SIZE == kMemSize,
+              "C interface constants must match the core");
+
+namespace {
+
+thread_local std::string last_error;
+
+int fail(std::string message) {
+  last_error = std::move(message);
+  return -1;
+}
+
+// nothing may unwind through the C interface
+template <typename Body> int guarded(Body &&body) {
+  try {
+    return body();
+  } catch (const std::exception &err) {
+    return fail(err.what());
+  }
+}
+
+struct reward_term {
+  uint16_t address = 0;
+  ace_env_value value = ACE_ENV_VALUE_BYTE;
+  float scale = 1;
+};
+
+int32_t read_value(const registers &regs, const reward_term &term) {
+  auto at = [&](int offset) -> int32_t {
+    return regs.mem[(term.address + offset) & (kMemSize - 1)];
+  };
+  switch (term.value) {
+  case ACE_ENV_VALUE_WORD:
+    return (at(0) << 8) | at(1);
+  case ACE_ENV_VALUE_BCD:
+    return at(0) * 100 + at(1) * 10 + at(2);
+  default:
+    return at(0);
+  }
+}
+
+struct environment {
+  std::shared_ptr<registers> regs = std::make_shared<registers>();
+  Interpreter interpreter{regs};
+  // last value of every reward term
+  std::vector<int32_t> values;
+};
+
+} // namespace
+
+struct ace_env_batch {
+  ace_env_options options{};
+  std::vector<std::unique_ptr<environment>> envs;
+  // every environment right after power on, resets resume from it
+  MachineFork power_on;
+  // null when stepping on the calling thread
+  std::unique_ptr<WorkStealingPool> pool;
+
+  size_t observation_size = 0;
+  std::vector<uint8_t> observations;
+  std::vector<float> rewards;
+
+  std::vector<reward_term> terms;
+  ace_env_reward_fn hook = nullptr;
+  void *hook_user = nullptr;
+
+  void for_each(const std::function<void(size_t env)> &task);
+  void reset(size_t env, uint32_t seed);
+  void observe(size_t env);
+  float reward(size_t env);
+};
+
+void ace_env_batch::for_each(const std::function<void(size_t env)> &task) {
+  if (!pool) {
+    for (size_t env = 0; env < envs.size(); env += 1) {
+      task(env);
+    }
+    return;
+  }
+
+  // the pool only logs what its tasks throw, hand the first failure back to
+  // the caller instead
+  std::mutex error_mutex;
+  std::exception_ptr error;
+
+  // a few chunks per worker, small enough for stealing to even them out
+  size_t chunk = std::max<size_t>(1, envs.size() / (pool->size() * 4));
+  for (size_t first = 0; first < envs.size(); first += chunk) {
+    size_t last = std::min(first + chunk, envs.size());
+    pool->submit([&task, &error_mutex, &error, first, last] {
+      try {
+        for (size_t env = first; env < last; env += 1) {
+          task(env);
+        }
+      } catch (...) {
+        std::lock_guard<std::mutex> lock(error_mutex);
+        if (!error) {
+          error = std::current_exception();
+        }
+      }
+    });
+  }
+  pool->wait();
+
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}
+
+void ace_env_batch::reset(size_t env, uint32_t seed) {
+  environment &e = *envs[env];
+
+  MachineFork start = power_on;
+  start.interpreter.rng = Random(seed).get_state();
+  start.interpreter.seed = seed;
+  e.interpreter.resume(start);
+
+  e.values.resize(terms.size());
+  for (size_t idx = 0; idx < terms.size(); idx += 1) {
+    e.values[idx] = read_value(*e.regs, terms[idx]);
+  }
+  rewards[env] = 0;
+  observe(env);
+}
+
+void ace_env_batch::observe(size_t env) {
+  const registers &regs = *envs[env]->regs;
+  uint8_t *out = &observations[env * observation_size];
+
+  if (options.observation == ACE_ENV_OBSERVATION_PIXELS) {
+    for (screen_row row : regs.screen) {
+      for (int x = 0; x < kScreenWidth; x += 1) {
+        *out++ = (row >> (kScreenWidth - 1 - x)) & 1;
+      }
+    }
+    return;
+  }
+
+  for (screen_row row : regs.screen) {
+    for (int byte = 0; byte < 8; byte += 1) {
+      *out++ = static_cast<uint8_t>(row >> (kScreenWidth - 8 * (byte + 1)));
+    }
+  }
+}
+
+float ace_env_batch::reward(size_t env) {
+  environment &e = *envs[env];
+
+  float total = 0;
+  for (size_t idx = 0; idx < terms.size(); idx += 1) {
+    int32_t value = read_value(*e.regs, terms[idx]);
+    total += terms[idx].scale * static_cast<float>(value - e.values[idx]);
+    e.values[idx] = value;
+  }
+  if (hook) {
+    total += hook(static_cast<uint32_t>(env), e.regs->mem.data(), hook_user);
+  }
+  return total;
+}
+
+namespace {
+
+tl::expected<void, std::string> check_options(const ace_env_options &options) {
+  if (options.count == 0) {
+    return tl::unexpected(std::string("count must be at least 1"));
+  }
+  if (options.play_rate <= 0) {
+    return tl::unexpected(std::string("play_rate must be positive"));
+  }
+  if (options.threads < 0) {
+    return tl::unexpected(std::string("threads must not be negative"));
+  }
+  if (options.backend != ACE_ENV_BACKEND_INTERPRETER &&
+      options.backend != ACE_ENV_BACKEND_RECOMPILER) {
+    return tl::unexpected(std::string("unknown backend"));
+  }
+  if (options.observation != ACE_ENV_OBSERVATION_BITS &&
+      options.observation != ACE_ENV_OBSERVATION_PIXELS) {
+    return tl::unexpected(std::string("unknown observation format"));
+  }
+  return {};
+}
+
+tl::expected<std::unique_ptr<ace_env_batch>, std::string>
+make_batch(const std::vector<uint8_t> &rom, const ace_env_options &options) {
+  if (auto checked = check_options(options); !checked) {
+    return tl::unexpected(checked.error());
+  }
+  if (rom.empty() || rom.size() > kMemSize - kRomStartIndex) {
+    return tl::unexpected(fmt::format("ROM is {} bytes, must be 1 to {}",
+                                      rom.size(),
+                                      kMemSize - kRomStartIndex));
+  }
+
+  auto batch = std::make_unique<ace_env_batch>();
+  batch->options = options;
+  backend_type backend = options.backend == ACE_ENV_BACKEND_RECOMPILER &&
+                                 Recompiler::is_supported()
+                             ? backend_type::recompiler
+                             : backend_type::interpreter;
+
+  {
+    environment scratch;
+    scratch.interpreter.update_play_rate = options.play_rate;
+    scratch.interpreter.set_seed(options.first_seed);
+    scratch.interpreter.initialize();
+    scratch.interpreter.load_rom_bytes(rom);
+    scratch.interpreter.fork(batch->power_on);
+  }
+
+  batch->observation_size = options.observation == ACE_ENV_OBSERVATION_PIXELS
+                                ? kScreenPixelCount
+                                : kScreenHeight * sizeof(screen_row);
+  batch->observations.resize(options.count * batch->observation_size);
+  batch->rewards.resize(options.count);
+
+  batch->envs.reserve(options.count);
+  for (uint32_t env = 0; env < options.count; env += 1) {
+    auto e = std::make_unique<environment>();
+    e->interpreter.update_play_rate = options.play_rate;
+    e->interpreter.set_backend(backend);
+    batch->envs.push_back(std::move(e));
+    batch->reset(env, options.first_seed + env);
+  }
+
+  if (options.threads != 1 && options.count > 1) {
+    batch->pool = std::make_unique<WorkStealingPool>(options.threads);
+  }
+  return batch;
+}
+
+} // namespace
+
+extern "C" {
+
+uint32_t ace_env_api_version(void) { return ACE_ENV_API_VERSION; }
+
+const char *ace_env_last_error(void) { return last_error.c_str(); }
+
+void ace_env_default_options(ace_env_options *options) {
+  if (!options) {
+    return;
+  }
+  *options = ace_env_options{};
+  options->struct_size = sizeof(ace_env_options);
+  options->count = 1;
+  options->play_rate = kDefaultPlayingUpdateRate;
+  options->backend = ACE_ENV_BACKEND_INTERPRETER;
+  options->observation = ACE_ENV_OBSERVATION_BITS;
+}
+
+ace_env_batch *ace_env_create(const uint8_t *rom, size_t rom_size,
+                              const ace_env_options *options) {
+  if (!rom || !options) {
+    fail("rom and options are required");
+    return nullptr;
+  }
+
+  // callers built against an older header pass a shorter struct, the
+  // fields it lacks keep their defaults
+  ace_env_options merged;
+  ace_env_default_options(&merged);
+  std::memcpy(&merged, options,
+              std::min<size_t>(options->struct_size, sizeof(merged)));
+  merged.struct_size = sizeof(merged);
+
+  ace_env_batch *created = nullptr;
+  guarded([&] {
+    auto batch = make_batch(std::vector<uint8_t>(rom, rom + rom_size), merged);
+    if (!batch) {
+      return fail(batch.error());
+    }
+    created = batch->release();
+    return 0;
+  });
+  return created;
+}
+
+void ace_env_destroy(ace_env_batch *batch) { delete batch; }
+
+uint32_t ace_env_count(const ace_env_batch *batch) {
+  return batch ? static_cast<uint32_t>(batch->envs.size()) : 0;
+}
+
+size_t ace_env_observation_size(const ace_env_batch *batch) {
+  return batch ? batch->observation_size : 0;
+}
+
+int ace_env_reset(ace_env_batch *batch, const uint32_t *seeds) {
+  if (!batch) {
+    return fail("batch is null");
+  }
+  return guarded([&] {
+    batch->for_each([&](size_t env) {
+      batch->reset(env, seeds ? seeds[env]
+                              : batch->options.first_seed +
+                                    static_cast<uint32_t>(env));
+    });
+    return 0;
+  });
+}
+
+int ace_env_reset_one(ace_env_batch *batch, uint32_t env, uint32_t seed) {
+  if (!batch || env >= batch->envs.size()) {
+    return fail("no such environment");
+  }
+  return guarded([&] {
+    batch->reset(env, seed);
+    return 0;
+  });
+}
+
+int ace_env_step(ace_env_batch *batch, const uint16_t *actions,
+                 uint32_t frames) {
+  if (!batch || !actions) {
+    return fail("batch and actions are required");
+  }
+  return guarded([&] {
+    batch->for_each([&](size_t env) {
+      environment &e = *batch->envs[env];
+      for (int key = 0; key < kKeyboardSize; key += 1) {
+        e.regs->kbd[key] = (actions[env] >> key) & 1;
+      }
+      uint32_t done = 0;
+      while (done < frames) {
+        done += e.interpreter.run_frames(static_cast<int>(
+            std::min<uint32_t>(frames - done, kMaxElidedFrames)));
+      }
+      batch->observe(env);
+      batch->rewards[env] = batch->reward(env);
+    });
+    return 0;
+  });
+}
+
+const uint8_t *ace_env_observations(const ace_env_batch *batch) {
+  return batch ? batch->observations.data() : nullptr;
+}
+
+const float *ace_env_rewards(const ace_env_batch *batch) {
+  return batch ? batch->rewards.data() : nullptr;
+}
+
+const uint8_t *ace_env_memory(const ace_env_batch *batch, uint32_t env) {
+  if (!batch || env >= batch->envs.size()) {
+    fail("no such environment");
+    return nullptr;
+  }
+  return batch->envs[env]->regs->mem.data();
+}
+
+int ace_env_add_reward_term(ace_env_batch *batch, uint16_t address,
+                            int32_t value, float scale) {
+  if (!batch) {
+    return fail("batch is null");
+  }
+  if (value != ACE_ENV_VALUE_BYTE && value != ACE_ENV_VALUE_WORD &&
+      value != ACE_ENV_VALUE_BCD) {
+    return fail("unknown value type");
+  }
+  return guarded([&] {
+    reward_term term;
+    term.address = address;
+    term.value = static_cast<ace_env_value>(value);
+    term.scale = scale;
+    batch->terms.push_back(term);
+    // changes count from now on
+    for (auto &e : batch->envs) {
+      e->values.push_back(read_value(*e->regs, term));
+    }
+    return 0;
+  });
+}
+
+int ace_env_set_reward_hook(ace_env_batch *batch, ace_env_reward_fn hook,
+                            void *user) {
+  if (!batch) {
+    return fail("batch is null");
+  }
+  batch->hook = hook;
+  batch->hook_user = user;
+  return 0;
+}
+
+} // extern "C"
@@ -0,0 +1,125 @@
+#pragma once
+
+// C interface for running batches of machines as training environments.
+// Every environment in a batch runs the same ROM with its own seed and
+// keypad; a step runs all of them on a thread pool and leaves observations
+// and rewards in arrays owned by the batch.
+//
+// The interface is plain C so it can be loaded from other languages. Structs
+// passed in start with their own size, and later versions only ever add
+// fields at the end.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(_WIN32)
+#if defined(ACE_ENV_BUILDING)
+#define ACE_ENV_API __declspec(dllexport)
+#else
+#define ACE_ENV_API __declspec(dllimport)
+#endif
+#else
+#define ACE_ENV_API __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ACE_ENV_API_VERSION 1
+
+#define ACE_ENV_SCREEN_WIDTH 64
+#define ACE_ENV_SCREEN_HEIGHT 32
+#define ACE_ENV_MEMORY_SIZE 4096
+
+typedef enum ace_env_backend {
+  ACE_ENV_BACKEND_INTERPRETER = 0,
+  // falls back to the interpreter where the recompiler isn't supported
+  ACE_ENV_BACKEND_RECOMPILER = 1,
+} ace_env_backend;
+
+typedef enum ace_env_observation {
+  // 8 bytes per row, leftmost pixel in the top bit of the first byte
+  ACE_ENV_OBSERVATION_BITS = 0,
+  // one byte per pixel, 0 or 1, row after row
+  ACE_ENV_OBSERVATION_PIXELS = 1,
+} ace_env_observation;
+
+typedef enum ace_env_value {
+  ACE_ENV_VALUE_BYTE = 0,
+  // two bytes, high byte first
+  ACE_ENV_VALUE_WORD = 1,
+  // three decimal digits as FX33 stores them
+  ACE_ENV_VALUE_BCD = 2,
+} ace_env_value;
+
+typedef struct ace_env_options {
+  // sizeof(ace_env_options) of the caller
+  uint32_t struct_size;
+  uint32_t count;
+  // environment n is seeded with first_seed + n
+  uint32_t first_seed;
+  // instructions per second of guest time
+  int32_t play_rate;
+  // 0 for one per core, 1 steps on the calling thread
+  int32_t threads;
+  int32_t backend;
+  int32_t observation;
+} ace_env_options;
+
+// Reward of one environment after a step, given its memory. Runs on the
+// pool's threads, concurrently for different environments.
+typedef float (*ace_env_reward_fn)(uint32_t env, const uint8_t *memory,
+                                   void *user);
+
+typedef struct ace_env_batch ace_env_batch;
+
+ACE_ENV_API uint32_t ace_env_api_version(void);
+
+// Message for the last failed call on this thread, empty if none failed.
+ACE_ENV_API const char *ace_env_last_error(void);
+
+ACE_ENV_API void ace_env_default_options(ace_env_options *options);
+
+// Returns NULL on failure. The ROM is copied.
+ACE_ENV_API ace_env_batch *ace_env_create(const uint8_t *rom, size_t rom_size,
+                                          const ace_env_options *options);
+ACE_ENV_API void ace_env_destroy(ace_env_batch *batch);
+
+ACE_ENV_API uint32_t ace_env_count(const ace_env_batch *batch);
+// bytes of one environment's observation
+ACE_ENV_API size_t ace_env_observation_size(const ace_env_batch *batch);
+
+// Powers every environment back on, environment n seeded with seeds[n], or
+// with the seed it was created with when seeds is NULL. Functions returning
+// int give 0 on success and -1 on failure.
+ACE_ENV_API int ace_env_reset(ace_env_batch *batch, const uint32_t *seeds);
+ACE_ENV_API int ace_env_reset_one(ace_env_batch *batch, uint32_t env,
+                                  uint32_t seed);
+
+// Holds actions[n], a keypad bitmask with key k in bit k, on environment n
+// for the given number of frames, then updates observations and rewards.
+ACE_ENV_API int ace_env_step(ace_env_batch *batch, const uint16_t *actions,
+                             uint32_t frames);
+
+// Views owned by the batch, valid until it is destroyed. Their contents
+// change with every reset and step. Observations of all environments are
+// one contiguous array, environment n at n * ace_env_observation_size().
+ACE_ENV_API const uint8_t *ace_env_observations(const ace_env_batch *batch);
+// reward of every environment for the last step
+ACE_ENV_API const float *ace_env_rewards(const ace_env_batch *batch);
+// ACE_ENV_MEMORY_SIZE bytes of guest memory of one environment
+ACE_ENV_API const uint8_t *ace_env_memory(const ace_env_batch *batch,
+                                          uint32_t env);
+
+// Adds scale times the change of the value at address over a step to the
+// reward. Terms add up, and add to the hook's reward.
+ACE_ENV_API int ace_env_add_reward_term(ace_env_batch *batch, uint16_t address,
+                                        int32_t value, float scale);
+// Replaces the reward hook, NULL removes it.
+ACE_ENV_API int ace_env_set_reward_hook(ace_env_batch *batch,
+                                        ace_env_reward_fn hook, void *user);
+
+#ifdef __cplusplus
+}
+#endif
@@ -3,6 +3,7 @@
 AppLog::AppLog() : auto_scroll(true) { clear(); }
 
 void AppLog::add_log(const std::string &log) {
+  std::lock_guard<std::mutex> lock(mutex);
   int old_size = buffer.size();
   buffer.append(log.c_str());
   for (int new_size = buffer.size(); old_size < new_size; old_size += 1) {
@@ -13,6 +14,11 @@ void AppLog::add_log(const std::string &log) {
 }
 
 void AppLog::clear() {
+  std::lock_guard<std::mutex> lock(mutex);
+  clear_buffer();
+}
+
+void AppLog::clear_buffer() {
   buffer.clear();
   line_offsets.clear();
   line_offsets.push_back(0);
@@ -39,8 +45,10 @@ void AppLog::draw() {
 
   if (ImGui::BeginChild("scrolling", ImVec2(0, 0), ImGuiChildFlags_None,
                         ImGuiWindowFlags_HorizontalScrollbar)) {
+    std::lock_guard<std::mutex> lock(mutex);
+
     if (should_clear) {
-      clear();
+      clear_buffer();
     }
 
     if (did_copy) {
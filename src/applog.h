@@ -1,6 +1,7 @@
 #pragma once
 
 #include <imgui.h>
+#include <mutex>
 #include <string>
 
 class AppLog {
@@ -12,6 +13,10 @@ public:
   void draw();
 
 private:
+  void clear_buffer();
+
+  // logs can arrive from the emulation thread while the UI draws
+  std::mutex mutex;
   ImGuiTextBuffer buffer;
   ImGuiTextFilter filter;
   ImVector<int> line_offsets;
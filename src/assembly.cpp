@@ -79,7 +79,7 @@ void AssemblyViewer::draw() {
         ImGui::SameLine();
 
         uint16_t instr = (hi << 8) | lo;
-        ImGui::Text(disassembled_instruction(instr).c_str());
+        ImGui::TextUnformatted(cached_disassembly(i, instr).c_str());
 
         if (is_greyed_out || is_current_line) {
           ImGui::PopStyleColor();
@@ -99,6 +99,15 @@ void AssemblyViewer::draw() {
 
 void AssemblyViewer::cleanup() { spdlog::trace("Initializing AssemblyViewer"); }
 
+const std::string &AssemblyViewer::cached_disassembly(int line,
+                                                     uint16_t instr) {
+  if (cached_text[line].empty() || cached_instr[line] != instr) {
+    cached_instr[line] = instr;
+    cached_text[line] = disassembled_instruction(instr);
+  }
+  return cached_text[line];
+}
+
 std::string AssemblyViewer::disassembled_instruction(uint16_t instr) const {
   int nnn = instr & 0xfff;
   int n = instr & 0xf;
@@ -2,15 +2,24 @@
 
 #include "registers.h"
 
+#include <array>
+#include <string>
+
 class AssemblyViewer {
 public:
   void initialize(const registers *regs);
   void draw();
   void cleanup();
 
-private:
   std::string disassembled_instruction(uint16_t instr) const;
+
+private:
+  const std::string &cached_disassembly(int line, uint16_t instr);
   bool auto_scroll = true;
 
+  // formatted text per line, only redone when the instruction word changes
+  std::array<uint16_t, kMemSize / 2> cached_instr{0};
+  std::array<std::string, kMemSize / 2> cached_text;
+
   const registers *regs = nullptr;
 };
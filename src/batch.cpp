@@ -0,0 +1,224 @@
+#include "batch.h"
+#include "hash.h"
+#include "movie.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <spdlog/spdlog.h>
+#include <unordered_map>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+std::string lowercase_extension(const fs::path &path) {
+  std::string ext = path.extension().string();
+  std::transform(ext.begin(), ext.end(), ext.begin(),
+                 [](unsigned char c) { return std::tolower(c); });
+  return ext;
+}
+
+std::string csv_field(const std::string &field) {
+  if (field.find_first_of(",\"\n") == std::string::npos) {
+    return field;
+  }
+  std::string quoted = "\"";
+  for (char c : field) {
+    quoted += c == '"' ? "\"\"" : std::string(1, c);
+  }
+  return quoted + "\"";
+}
+
+std::string json_string(const std::string &str) {
+  std::string escaped = "\"";
+  for (char c : str) {
+    if (c == '"' || c == '\\') {
+      escaped += '\\';
+      escaped += c;
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      escaped += fmt::format("\\u{:04x}", c);
+    } else {
+      escaped += c;
+    }
+  }
+  return escaped + "\"";
+}
+
+double instructions_per_second(const headless_result &result) {
+  return result.seconds > 0 ? result.instructions / result.seconds : 0;
+}
+
+} // namespace
+
+tl::expected<std::vector<headless_options>, std::string>
+make_batch_jobs(const std::vector<std::string> &rom_paths,
+                const std::vector<std::string> &movie_paths, int seed_count,
+                const headless_options &base) {
+  std::vector<std::string> roms;
+  for (const std::string &path : rom_paths) {
+    std::error_code err;
+    if (!fs::is_directory(path, err)) {
+      roms.push_back(path);
+      continue;
+    }
+
+    std::vector<std::string> found;
+    for (const auto &entry : fs::directory_iterator(path, err)) {
+      if (!entry.is_regular_file()) {
+        continue;
+      }
+      std::string ext = lowercase_extension(entry.path());
+      if (ext == ".ch8" || ext == ".c8") {
+        found.push_back(entry.path().string());
+      }
+    }
+    std::sort(found.begin(), found.end());
+    roms.insert(roms.end(), found.begin(), found.end());
+  }
+
+  std::vector<headless_options> jobs;
+  if (base.frames > 0 || base.instructions > 0) {
+    uint32_t first_seed = base.seed.value_or(0);
+    for (const std::string &rom : roms) {
+      for (int idx = 0; idx < seed_count; idx += 1) {
+        headless_options job = base;
+        job.rom_path = rom;
+        job.seed = first_seed + idx;
+        job.movie_path.clear();
+        jobs.push_back(job);
+      }
+    }
+  }
+
+  if (movie_paths.empty()) {
+    return jobs;
+  }
+
+  std::unordered_map<uint64_t, std::string> roms_by_hash;
+  for (const std::string &rom : roms) {
+    if (auto bytes = read_rom(rom)) {
+      roms_by_hash.emplace(hash_bytes(bytes->data(), bytes->size()), rom);
+    }
+  }
+
+  for (const std::string &path : movie_paths) {
+    auto replay = movie::load(path);
+    if (!replay) {
+      return tl::unexpected(fmt::format("{}: {}", path, replay.error()));
+    }
+    auto rom = roms_by_hash.find(replay->rom_hash);
+    if (rom == roms_by_hash.end()) {
+      return tl::unexpected(
+          fmt::format("{}: none of the ROMs matches the movie", path));
+    }
+
+    headless_options job = base;
+    job.rom_path = rom->second;
+    job.movie_path = path;
+    jobs.push_back(job);
+  }
+  return jobs;
+}
+
+std::vector<batch_result> run_batch(const std::vector<headless_options> &jobs,
+                                    unsigned thread_count) {
+  std::vector<batch_result> results(jobs.size());
+
+  WorkStealingPool pool(thread_count);
+  spdlog::info("Running {} jobs on {} threads", jobs.size(), pool.size());
+
+  for (size_t idx = 0; idx < jobs.size(); idx += 1) {
+    // every job writes its own slot, nothing else is shared
+    pool.submit([&jobs, &results, idx] {
+      batch_result &out = results[idx];
+      out.job = jobs[idx];
+      // the pool only logs what a job throws, keep it with the job's row
+      try {
+        registers regs;
+        auto result = run_headless(jobs[idx], regs);
+        if (result) {
+          out.result = result.value();
+        } else {
+          out.error = result.error();
+        }
+      } catch (const std::exception &err) {
+        out.error = err.what();
+      }
+      if (!out.error.empty()) {
+        spdlog::warn("{}: {}", jobs[idx].rom_path, out.error);
+      }
+    });
+  }
+  pool.wait();
+
+  return results;
+}
+
+std::string format_batch_csv(const std::vector<batch_result> &results) {
+  std::string out = "rom,movie,seed,frames,instructions,cycles,seconds,"
+                    "instructions_per_second,state_hash,error\n";
+  for (const batch_result &entry : results) {
+    out += csv_field(entry.job.rom_path) + "," +
+           csv_field(entry.job.movie_path) + ",";
+    if (entry.result) {
+      const headless_result &r = entry.result.value();
+      out += fmt::format("{},{},{},{},{:.6f},{:.0f},{:016x},", r.seed,
+                         r.frames, r.instructions, r.cycles, r.seconds,
+                         instructions_per_second(r), r.state_hash);
+    } else {
+      out += ",,,,,,,";
+    }
+    out += csv_field(entry.error) + "\n";
+  }
+  return out;
+}
+
+std::string format_batch_json(const std::vector<batch_result> &results) {
+  std::string out = "{\n  \"results\": [\n";
+  for (size_t idx = 0; idx < results.size(); idx += 1) {
+    const batch_result &entry = results[idx];
+    out += fmt::format("    {{\"rom\": {}, \"movie\": {}",
+                       json_string(entry.job.rom_path),
+                       json_string(entry.job.movie_path));
+    if (entry.result) {
+      const headless_result &r = entry.result.value();
+      out += fmt::format(
+          ", \"seed\": {}, \"frames\": {}, \"instructions\": {}, "
+          "\"cycles\": {}, \"seconds\": {:.6f}, "
+          "\"instructions_per_second\": {:.0f}, \"state_hash\": \"{:016x}\"",
+          r.seed, r.frames, r.instructions, r.cycles, r.seconds,
+          instructions_per_second(r), r.state_hash);
+    } else {
+      out += fmt::format(", \"error\": {}", json_string(entry.error));
+    }
+    out += idx + 1 < results.size() ? "},\n" : "}\n";
+  }
+  out += "  ]\n}\n";
+  return out;
+}
+
+tl::expected<void, std::string>
+write_batch_summary(const std::vector<batch_result> &results,
+                    const std::string &path) {
+  std::string ext = lowercase_extension(path);
+  std::string summary;
+  if (ext == ".csv") {
+    summary = format_batch_csv(results);
+  } else if (ext == ".json") {
+    summary = format_batch_json(results);
+  } else {
+    return tl::unexpected(
+        fmt::format("unsupported summary format \"{}\", use .csv or .json",
+                    ext));
+  }
+
+  std::ofstream file(path, std::ios::binary);
+  file << summary;
+  if (!file) {
+    return tl::unexpected(fmt::format("failed to write {}", path));
+  }
+  return {};
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "headless.h"
+
+#include <optional>
+#include <string>
+#include <tl/expected.hpp>
+#include <vector>
+
+struct batch_result {
+  headless_options job;
+  std::optional<headless_result> result;
+  std::string error;
+};
+
+// Expands directories in rom_paths to the .ch8 and .c8 files in them, then
+// makes seed_count runs of every ROM with consecutive seeds starting at
+// base.seed, if base asks for a run length, and one run of every movie with
+// the ROM it was recorded on.
+tl::expected<std::vector<headless_options>, std::string>
+make_batch_jobs(const std::vector<std::string> &rom_paths,
+                const std::vector<std::string> &movie_paths, int seed_count,
+                const headless_options &base);
+
+// Runs every job on its own interpreter across a work-stealing pool. Results
+// come back in job order.
+std::vector<batch_result> run_batch(const std::vector<headless_options> &jobs,
+                                    unsigned thread_count = 0);
+
+std::string format_batch_csv(const std::vector<batch_result> &results);
+std::string format_batch_json(const std::vector<batch_result> &results);
+// CSV or JSON depending on the extension of path
+tl::expected<void, std::string>
+write_batch_summary(const std::vector<batch_result> &results,
+                    const std::string &path);
@@ -0,0 +1,426 @@
+#include "applog.h"
+#include "assembly.h"
+#include "fork.h"
+#include "interpreter.h"
+#include "lockstep.h"
+#include "random.h"
+#include "save_state.h"
+#include "registers.h"
+#include "screen.h"
+#include "sound.h"
+#include "timer.h"
+
+#include <algorithm>
+#include <argparse/argparse.hpp>
+#include <cstdio>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <spdlog/sinks/stdout_color_sinks.h>
+#include <spdlog/spdlog.h>
+#include <string>
+#include <vector>
+
+// Microbenchmarks for the emulator's hot paths. Nothing here opens a window
+// or an audio device, the screen and sound benchmarks run the CPU halves of
+// Screen::update() and SoundManager::update().
+
+namespace {
+
+constexpr double kDefaultMinTime = 0.2;
+constexpr int kDefaultRepetitions = 5;
+// instructions per frame when benchmarking whole frames
+constexpr int kFrameBenchmarkRate = 60 * 10000;
+constexpr uint16_t kSubroutineAddr = 0xe00;
+
+struct benchmark_result {
+  std::string name;
+  uint64_t iterations = 0;
+  int repetitions = 0;
+  double ns_per_op = 0;
+  double min_ns_per_op = 0;
+  double max_ns_per_op = 0;
+};
+
+struct benchmark_options {
+  double min_time = kDefaultMinTime;
+  int repetitions = kDefaultRepetitions;
+  std::string filter;
+};
+
+// keeps results alive so the compiler can't drop the work
+volatile uint64_t sink = 0;
+
+class BenchmarkRunner {
+public:
+  explicit BenchmarkRunner(benchmark_options options)
+      : options(std::move(options)) {}
+
+  // func runs the measured operation the given number of times, each
+  // iteration covering ops_per_iteration operations
+  void run(const std::string &name, uint64_t ops_per_iteration,
+           const std::function<void(uint64_t)> &func) {
+    if (!options.filter.empty() &&
+        name.find(options.filter) == std::string::npos) {
+      return;
+    }
+
+    uint64_t iterations = calibrate(func);
+
+    std::vector<double> samples;
+    for (int rep = 0; rep < options.repetitions; rep += 1) {
+      Timer timer;
+      func(iterations);
+      double elapsed = timer.duration();
+      samples.push_back(elapsed * 1e9 / (iterations * ops_per_iteration));
+    }
+    std::sort(samples.begin(), samples.end());
+
+    benchmark_result result;
+    result.name = name;
+    result.iterations = iterations;
+    result.repetitions = options.repetitions;
+    result.ns_per_op = samples[samples.size() / 2];
+    result.min_ns_per_op = samples.front();
+    result.max_ns_per_op = samples.back();
+
+    fmt::print(stderr, "{:<40} {:>12.2f} ns/op {:>14} iterations\n", name,
+               result.ns_per_op, iterations);
+    results.push_back(result);
+  }
+
+  std::string to_json() const {
+    std::string out = "{\n  \"benchmarks\": [\n";
+    for (size_t idx = 0; idx < results.size(); idx += 1) {
+      const benchmark_result &r = results[idx];
+      out += fmt::format(
+          "    {{\"name\": \"{}\", \"iterations\": {}, \"repetitions\": {}, "
+          "\"ns_per_op\": {:.4f}, \"min_ns_per_op\": {:.4f}, "
+          "\"max_ns_per_op\": {:.4f}}}{}\n",
+          r.name, r.iterations, r.repetitions, r.ns_per_op, r.min_ns_per_op,
+          r.max_ns_per_op, idx + 1 < results.size() ? "," : "");
+    }
+    out += "  ]\n}\n";
+    return out;
+  }
+
+private:
+  // grows the iteration count until one run takes min_time
+  uint64_t calibrate(const std::function<void(uint64_t)> &func) {
+    uint64_t iterations = 1;
+    while (true) {
+      Timer timer;
+      func(iterations);
+      double elapsed = timer.duration();
+      if (elapsed >= options.min_time) {
+        return iterations;
+      }
+      double scale = elapsed > 0 ? options.min_time / elapsed * 1.2 : 100.0;
+      iterations = static_cast<uint64_t>(
+          iterations * std::clamp(scale, 2.0, 100.0));
+    }
+  }
+
+  benchmark_options options;
+  std::vector<benchmark_result> results;
+};
+
+// A ROM that runs setup once and then loops over body, repeated to make the
+// loop's closing jump a small share of the instructions.
+std::vector<uint8_t> make_rom(std::vector<uint16_t> setup,
+                              std::vector<uint16_t> body, int repeat = 32) {
+  std::vector<uint16_t> words = std::move(setup);
+  uint16_t loop = kRomStartIndex + words.size() * 2;
+  for (int rep = 0; rep < repeat; rep += 1) {
+    words.insert(words.end(), body.begin(), body.end());
+  }
+  words.push_back(0x1000 | loop);
+
+  std::vector<uint8_t> rom;
+  for (uint16_t word : words) {
+    rom.push_back(word >> 8);
+    rom.push_back(word & 0xff);
+  }
+  return rom;
+}
+
+struct machine {
+  std::shared_ptr<registers> regs = std::make_shared<registers>();
+  Interpreter interpreter{regs};
+
+  explicit machine(const std::vector<uint8_t> &rom,
+                   backend_type backend = backend_type::interpreter,
+                   int play_rate = kDefaultPlayingUpdateRate) {
+    interpreter.update_play_rate = play_rate;
+    interpreter.set_seed(1);
+    interpreter.set_backend(backend);
+    interpreter.initialize();
+    interpreter.load_rom_bytes(rom);
+    // subroutine for CALL benchmarks
+    regs->mem[kSubroutineAddr] = 0x00;
+    regs->mem[kSubroutineAddr + 1] = 0xee;
+    interpreter.invalidate_memory(kSubroutineAddr, 2);
+  }
+};
+
+const std::vector<uint16_t> kAluBody = {
+    0x7001, 0x8104, 0x8215, 0x8311, 0x8422, 0x8533,
+    0x8606, 0x870e, 0x8817, 0x6920, 0x8a90, 0x7b03,
+};
+
+const std::vector<uint16_t> kMemoryBody = {
+    0xa800, 0xf033, 0xf355, 0xf365, 0xf01e, 0xf129, 0xa900, 0xf755,
+};
+
+const std::vector<uint16_t> kBranchBody = {
+    0x3000, 0x6101, 0x4001, 0x6102, 0x5010, 0x6103,
+    0x9010, 0x6104, 0x2000 | kSubroutineAddr,
+};
+
+const std::vector<uint16_t> kDrawBody = {0xd015, 0xd235, 0xd455, 0xd675};
+
+const std::vector<uint16_t> kDrawSetup = {
+    0xa050, 0x6000, 0x6105, 0x623b, 0x631c, 0x6419, 0x6502, 0x6622, 0x670e,
+};
+
+void step_benchmark(BenchmarkRunner &runner, const std::string &name,
+                    const std::vector<uint8_t> &rom) {
+  machine m(rom);
+  runner.run(name, 1, [&](uint64_t iterations) {
+    for (uint64_t i = 0; i < iterations; i += 1) {
+      m.interpreter.step();
+    }
+    sink = sink + m.regs->pc;
+  });
+}
+
+void frame_benchmark(BenchmarkRunner &runner, const std::string &name,
+                     const std::vector<uint8_t> &rom, backend_type backend) {
+  machine m(rom, backend, kFrameBenchmarkRate);
+  runner.run(name, kFrameBenchmarkRate / kTimerRate,
+             [&](uint64_t iterations) {
+               for (uint64_t i = 0; i < iterations; i += 1) {
+                 m.interpreter.run_frame();
+               }
+               sink = sink + m.regs->pc;
+             });
+}
+
+// ns per lane-instruction, comparable with the scalar frame benchmarks
+void lockstep_benchmark(BenchmarkRunner &runner, const std::string &name,
+                        const std::vector<uint8_t> &rom, size_t lanes) {
+  LockstepEngine engine(lanes);
+  engine.update_play_rate = kFrameBenchmarkRate;
+  engine.reset(1);
+  engine.load_rom_bytes(rom);
+  runner.run(name, lanes * (kFrameBenchmarkRate / kTimerRate),
+             [&](uint64_t iterations) {
+               engine.run_frames(static_cast<int>(iterations));
+               sink = sink + engine.get_cycle();
+             });
+}
+
+// lanes take different sides of each skip and meet again after it
+const std::vector<uint16_t> kDivergentBody = {
+    0xc003, 0x3000, 0x7101, 0x3001, 0x7102, 0x3002, 0x7103,
+};
+
+void run_all(BenchmarkRunner &runner) {
+  std::vector<uint16_t> mixed = kAluBody;
+  mixed.insert(mixed.end(), kMemoryBody.begin(), kMemoryBody.end());
+  mixed.insert(mixed.end(), kBranchBody.begin(), kBranchBody.end());
+  mixed.push_back(0xd015);
+
+  step_benchmark(runner, "interpreter/step/alu", make_rom({}, kAluBody));
+  step_benchmark(runner, "interpreter/step/memory", make_rom({}, kMemoryBody));
+  step_benchmark(runner, "interpreter/step/branch", make_rom({}, kBranchBody));
+  step_benchmark(runner, "interpreter/step/mixed", make_rom({}, mixed, 8));
+  step_benchmark(runner, "interpreter/step/drw",
+                 make_rom(kDrawSetup, kDrawBody));
+  step_benchmark(runner, "interpreter/step/drw_tall",
+                 make_rom({0xa050, 0x6010, 0x6108}, {0xd01f}));
+  step_benchmark(runner, "interpreter/step/cls", make_rom({}, {0x00e0}));
+
+  frame_benchmark(runner, "interpreter/frame/alu", make_rom({}, kAluBody),
+                  backend_type::interpreter);
+  if (Recompiler::is_supported()) {
+    frame_benchmark(runner, "recompiler/frame/alu", make_rom({}, kAluBody),
+                    backend_type::recompiler);
+  }
+
+  {
+    // forking against the full copy a save state makes
+    machine m(make_rom({}, kMemoryBody));
+    m.interpreter.run_frames(1);
+    MachineFork child;
+    runner.run("fork/fork", 1, [&](uint64_t iterations) {
+      for (uint64_t i = 0; i < iterations; i += 1) {
+        m.interpreter.fork(child);
+      }
+      sink = sink + child.pc;
+    });
+    runner.run("fork/resume", 1, [&](uint64_t iterations) {
+      for (uint64_t i = 0; i < iterations; i += 1) {
+        m.interpreter.resume(child);
+      }
+      sink = sink + m.regs->pc;
+    });
+    // each fork is stepped once, dirtying memory for the next fork
+    runner.run("fork/fork_step", 1, [&](uint64_t iterations) {
+      for (uint64_t i = 0; i < iterations; i += 1) {
+        m.interpreter.fork(child);
+        m.interpreter.step();
+      }
+      sink = sink + child.pc;
+    });
+    auto copy = std::make_unique<save_state>();
+    runner.run("fork/save_state_copy", 1, [&](uint64_t iterations) {
+      for (uint64_t i = 0; i < iterations; i += 1) {
+        copy->regs = *m.regs;
+        m.interpreter.save_state(copy->interpreter);
+      }
+      sink = sink + copy->regs.pc;
+    });
+  }
+
+  for (size_t lanes : {32, 256}) {
+    lockstep_benchmark(runner, fmt::format("lockstep/frame/alu/{}", lanes),
+                       make_rom({}, kAluBody), lanes);
+    lockstep_benchmark(runner,
+                       fmt::format("lockstep/frame/divergent/{}", lanes),
+                       make_rom({}, kDivergentBody), lanes);
+  }
+
+  {
+    registers regs;
+    Random rng(1);
+    for (screen_row &row : regs.screen) {
+      row = (static_cast<screen_row>(rng.next()) << 32) | rng.next();
+    }
+    std::vector<Color> pixels(kScreenPixelCount);
+    runner.run("screen/rasterize", 1, [&](uint64_t iterations) {
+      for (uint64_t i = 0; i < iterations; i += 1) {
+        regs.screen[i % kScreenHeight] ^= i;
+        rasterize_screen(regs, pixels.data());
+      }
+      sink = sink + pixels[iterations % kScreenPixelCount].r;
+    });
+  }
+
+  {
+    AssemblyViewer assembly;
+    runner.run("assembly/disassemble", 1, [&](uint64_t iterations) {
+      size_t total = 0;
+      for (uint64_t i = 0; i < iterations; i += 1) {
+        total += assembly.disassembled_instruction(i & 0xffff).size();
+      }
+      sink = sink + total;
+    });
+  }
+
+  for (int type = 0; type < wave_type_count(); type += 1) {
+    WaveGeneratorSource source;
+    source.set_wave_type(type);
+    std::string name = fmt::format("sound/wave/{}", wave_type_name(type));
+    runner.run(name, kMaxSamplesPerUpdate, [&](uint64_t iterations) {
+      double time = 0;
+      for (uint64_t i = 0; i < iterations; i += 1) {
+        source.update(true, time);
+        time += static_cast<double>(kMaxSamplesPerUpdate) / kAudioSampleRate;
+      }
+      sink = sink + static_cast<uint64_t>(source.get_samples()[0] * 1000);
+    });
+  }
+
+  {
+    SoundManager sounds;
+    for (int type = 0; type < wave_type_count(); type += 1) {
+      auto source = std::make_unique<WaveGeneratorSource>();
+      source->set_wave_type(type);
+      sounds.add_source(std::move(source));
+    }
+    runner.run("sound/mix", kMaxSamplesPerUpdate, [&](uint64_t iterations) {
+      for (uint64_t i = 0; i < iterations; i += 1) {
+        sounds.mix(true);
+      }
+      sink = sink + sounds.get_buffer()[0];
+    });
+  }
+
+  {
+    AppLog log;
+    const std::string line =
+        "[2024-01-01 00:00:00.000] [info] Breakpoint hit at 2a4\n";
+    runner.run("applog/add_log", 1, [&](uint64_t iterations) {
+      for (uint64_t i = 0; i < iterations; i += 1) {
+        // bound the buffer like a user clearing the log now and then
+        if (i % 65536 == 0) {
+          log.clear();
+        }
+        log.add_log(line);
+      }
+    });
+  }
+}
+
+} // namespace
+
+auto main(int argc, char *argv[]) -> int {
+  // progress goes to stderr, stdout is reserved for the JSON report
+  spdlog::set_default_logger(spdlog::stderr_color_mt("bench"));
+  spdlog::set_level(spdlog::level::warn);
+
+  argparse::ArgumentParser program("ace-chip8-bench", "0.0.1");
+
+  program.add_argument("--filter")
+      .help("Only run benchmarks whose name contains this string")
+      .default_value(std::string(""))
+      .nargs(1);
+
+  program.add_argument("--min-time")
+      .help("Seconds each repetition should run for")
+      .default_value(kDefaultMinTime)
+      .scan<'g', double>()
+      .nargs(1);
+
+  program.add_argument("--repetitions")
+      .help("Measured runs per benchmark, the median is reported")
+      .default_value(kDefaultRepetitions)
+      .scan<'i', int>()
+      .nargs(1);
+
+  program.add_argument("--output")
+      .help("Write the JSON report to this file instead of stdout")
+      .default_value(std::string(""))
+      .nargs(1);
+
+  try {
+    program.parse_args(argc, argv);
+  } catch (const std::exception &err) {
+    std::cerr << err.what() << std::endl;
+    std::cerr << program;
+    return 1;
+  }
+
+  benchmark_options options;
+  options.filter = program.get("--filter");
+  options.min_time = program.get<double>("--min-time");
+  options.repetitions = std::max(program.get<int>("--repetitions"), 1);
+
+  BenchmarkRunner runner(options);
+  run_all(runner);
+
+  std::string json = runner.to_json();
+  const std::string output = program.get("--output");
+  if (output.empty()) {
+    fmt::print("{}", json);
+  } else if (FILE *file = std::fopen(output.c_str(), "w")) {
+    std::fputs(json.c_str(), file);
+    std::fclose(file);
+  } else {
+    spdlog::error("Failed to write {}", output);
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,497 @@
+#include "emulator.h"
+#include "hash.h"
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <spdlog/spdlog.h>
+
+using namespace std::chrono;
+
+namespace fs = std::filesystem;
+
+const char *const kSaveStateDirectory = "states";
+
+static uint64_t hash_rom(const std::vector<uint8_t> &rom) {
+  return hash_bytes(rom.data(), rom.size());
+}
+
+Emulator::Emulator()
+    : regs(std::make_shared<registers>()), interpreter(regs) {
+  interpreter.set_frame_callback([this] { capture_frame(false); });
+  interpreter.set_input_callback([this](uint64_t cycle) { feed_input(cycle); });
+}
+
+Emulator::~Emulator() { cleanup(); }
+
+void Emulator::initialize() {
+  interpreter.initialize();
+  capture_frame(true);
+  publish_state();
+
+  running = true;
+  thread = std::thread(&Emulator::run, this);
+
+  spdlog::info("Started emulation thread");
+}
+
+void Emulator::cleanup() {
+  if (!thread.joinable()) {
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(wake_mutex);
+    running = false;
+  }
+  wake.notify_one();
+  thread.join();
+
+  interpreter.cleanup();
+  spdlog::info("Stopped emulation thread");
+}
+
+void Emulator::send(emulator_command command) {
+  if (!commands.push(std::move(command))) {
+    spdlog::warn("Emulator command queue is full, dropping command");
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(wake_mutex);
+  wake.notify_one();
+}
+
+const emulator_state &Emulator::get_state() { return states.read(); }
+
+void Emulator::run() {
+  const auto tick = duration_cast<steady_clock::duration>(
+      duration<double>(1.0 / kEmulationTickRate));
+  auto next_tick = steady_clock::now();
+
+  while (running) {
+    while (auto command = commands.pop()) {
+      handle_command(*command);
+    }
+
+    if (rewinding) {
+      rewind_frames();
+    } else {
+      interpreter.update();
+    }
+    publish_state();
+
+    if (!interpreter.is_playing() && !rewinding) {
+      // nothing to run until the UI sends something
+      std::unique_lock<std::mutex> lock(wake_mutex);
+      wake.wait_for(lock, kPausedWakeInterval,
+                    [this] { return !running || !commands.empty(); });
+      next_tick = steady_clock::now();
+      continue;
+    }
+
+    next_tick += tick;
+    auto now = steady_clock::now();
+    if (now - next_tick > tick * kEmulationTickRate / 10) {
+      // fell too far behind, don't try to catch up on every missed tick
+      next_tick = now;
+    }
+    std::this_thread::sleep_until(next_tick);
+  }
+}
+
+void Emulator::handle_command(emulator_command &command) {
+  switch (command.type) {
+  case emulator_command_type::play:
+    interpreter.play();
+    break;
+  case emulator_command_type::stop:
+    interpreter.stop();
+    break;
+  case emulator_command_type::step:
+    spdlog::debug("Single step");
+    interpreter.step();
+    break;
+  case emulator_command_type::reset:
+    stop_movie();
+    interpreter.stop();
+    interpreter.reset();
+    interpreter.load_rom_bytes(rom);
+    rewind.clear();
+    capture_frame(true);
+    break;
+  case emulator_command_type::load_rom:
+    stop_movie();
+    rom = std::move(command.data);
+    rom_hash = hash_rom(rom);
+    // states from the previous ROM don't apply anymore
+    filled_slots = 0;
+    for (SaveSlotFile &file : disk_slots) {
+      file.close();
+    }
+    interpreter.stop();
+    interpreter.reset();
+    interpreter.load_rom_bytes(rom);
+    rewind.clear();
+    capture_frame(true);
+    if (command.value) {
+      interpreter.play();
+    }
+    break;
+  case emulator_command_type::set_key:
+    if (movie_status == movie_mode::recording) {
+      recorder.set_key(command.index, command.value != 0);
+    } else if (movie_status == movie_mode::none) {
+      regs->kbd[command.index & (kKeyboardSize - 1)] = command.value != 0;
+    }
+    // a replaying movie owns the keypad
+    break;
+  case emulator_command_type::write_memory:
+    regs->mem[command.index & (kMemSize - 1)] = command.value;
+    interpreter.invalidate_memory(command.index & (kMemSize - 1));
+    break;
+  case emulator_command_type::set_delay_timer:
+    regs->dt = command.value;
+    break;
+  case emulator_command_type::set_sound_timer:
+    regs->st = command.value;
+    break;
+  case emulator_command_type::flip_pixel:
+    regs->flip_pixel_at(command.index % kScreenWidth,
+                        (command.index / kScreenWidth) % kScreenHeight);
+    break;
+  case emulator_command_type::set_play_rate:
+    if (movie_status != movie_mode::none) {
+      spdlog::warn("Can't change the instruction rate during a movie");
+      break;
+    }
+    interpreter.update_play_rate = command.value;
+    break;
+  case emulator_command_type::set_speed:
+    interpreter.speed = std::max(command.value, 1) / 100.0;
+    break;
+  case emulator_command_type::set_unthrottled:
+    interpreter.unthrottled = command.value != 0;
+    break;
+  case emulator_command_type::set_max_catch_up_frames:
+    interpreter.max_catch_up_frames = std::max(command.value, 1);
+    break;
+  case emulator_command_type::set_backend:
+    interpreter.set_backend(static_cast<backend_type>(command.value));
+    break;
+  case emulator_command_type::set_seed:
+    fixed_seed = command.index ? std::optional<uint32_t>(command.value)
+                               : std::nullopt;
+    interpreter.set_seed(fixed_seed);
+    break;
+  case emulator_command_type::save_state:
+    save_slot(command.index, command.value != 0);
+    break;
+  case emulator_command_type::load_state:
+    if (movie_status != movie_mode::none) {
+      spdlog::warn("Can't load a state during a movie");
+      break;
+    }
+    load_slot(command.index, command.value != 0);
+    break;
+  case emulator_command_type::set_rewinding:
+    if ((command.value != 0) == rewinding) {
+      break;
+    }
+    if (command.value && movie_status != movie_mode::none) {
+      spdlog::warn("Can't rewind during a movie");
+      break;
+    }
+    rewinding = command.value != 0;
+    if (rewinding) {
+      resume_playing = interpreter.is_playing();
+      interpreter.stop();
+      rewind_pending = 0;
+    } else if (resume_playing) {
+      interpreter.play();
+    }
+    break;
+  case emulator_command_type::step_back:
+    if (movie_status != movie_mode::none) {
+      spdlog::warn("Can't step back during a movie");
+      break;
+    }
+    step_back();
+    break;
+  case emulator_command_type::start_recording: {
+    if (rom.empty()) {
+      spdlog::warn("Load a ROM before recording a movie");
+      break;
+    }
+    stop_movie();
+    restart_for_movie(std::nullopt, interpreter.update_play_rate);
+    recorder.start(interpreter.get_seed(), interpreter.update_play_rate,
+                   rom_hash);
+    movie_status = movie_mode::recording;
+    spdlog::info("Recording movie with seed {}", interpreter.get_seed());
+    break;
+  }
+  case emulator_command_type::stop_recording: {
+    if (movie_status != movie_mode::recording) {
+      break;
+    }
+    movie_status = movie_mode::none;
+    const movie &recording = recorder.finish(interpreter.get_cycle());
+    if (command.path.empty()) {
+      spdlog::info("Discarded movie");
+    } else if (auto result = recording.save(command.path); !result) {
+      spdlog::error("Failed to save movie: {}", result.error());
+    } else {
+      spdlog::info("Saved movie with {} inputs to {}", recording.events.size(),
+                   command.path);
+    }
+    break;
+  }
+  case emulator_command_type::start_replay: {
+    auto replay = movie::load(command.path);
+    if (!replay) {
+      spdlog::error("Failed to load movie: {}", replay.error());
+      break;
+    }
+    if (replay->rom_hash != rom_hash) {
+      spdlog::error("Movie was recorded with a different ROM");
+      break;
+    }
+    stop_movie();
+    uint32_t seed = replay->seed;
+    int play_rate = replay->play_rate;
+    player.start(std::move(*replay));
+    movie_status = movie_mode::replaying;
+    restart_for_movie(seed, play_rate);
+    spdlog::info("Replaying movie {}", command.path);
+    break;
+  }
+  case emulator_command_type::stop_replay:
+    if (movie_status == movie_mode::replaying) {
+      stop_movie();
+    }
+    break;
+  case emulator_command_type::share_state:
+    if (command.path.empty()) {
+      shared_state.close();
+    } else if (shared_state.open(command.path)) {
+      shared_state.publish(*regs, interpreter.get_cycle(),
+                           interpreter.get_stats().frames,
+                           interpreter.is_playing());
+    }
+    break;
+  }
+}
+
+void Emulator::restart_for_movie(std::optional<uint32_t> seed, int play_rate) {
+  // a movie plays back from power-on, everything it depends on starts over
+  rewinding = false;
+  interpreter.update_play_rate = play_rate;
+  interpreter.stop();
+  if (seed) {
+    interpreter.set_seed(seed);
+  }
+  interpreter.reset();
+  interpreter.set_seed(fixed_seed);
+  interpreter.load_rom_bytes(rom);
+  rewind.clear();
+  capture_frame(true);
+  interpreter.play();
+}
+
+void Emulator::stop_movie() {
+  if (movie_status == movie_mode::recording) {
+    spdlog::warn("Movie recording stopped without saving");
+  } else if (movie_status == movie_mode::replaying) {
+    spdlog::info("Stopped replaying movie");
+  }
+  movie_status = movie_mode::none;
+}
+
+void Emulator::feed_input(uint64_t cycle) {
+  if (shared_state.is_open()) {
+    feed_shared_input();
+  }
+  if (movie_status == movie_mode::recording) {
+    recorder.apply(cycle, regs->kbd);
+  } else if (movie_status == movie_mode::replaying) {
+    player.apply(cycle, regs->kbd);
+    if (player.is_finished(cycle)) {
+      spdlog::info("Movie finished");
+      movie_status = movie_mode::none;
+    }
+  }
+}
+
+void Emulator::feed_shared_input() {
+  uint32_t input = shared_state.read_input();
+  uint16_t claimed = input >> 16;
+  for (int key = 0; claimed != 0 && key < kKeyboardSize; key += 1) {
+    if (!(claimed & (1 << key))) {
+      continue;
+    }
+    bool down = (input >> key) & 1;
+    // same rules as keys from the UI
+    if (movie_status == movie_mode::recording) {
+      recorder.set_key(key, down);
+    } else if (movie_status == movie_mode::none) {
+      regs->kbd[key] = down;
+    }
+  }
+}
+
+void Emulator::save_slot(int slot, bool to_disk) {
+  if (slot < 0 || slot >= kSaveSlotCount) {
+    return;
+  }
+
+  save_state &state = slots[slot];
+  state.stamp();
+  state.regs = *regs;
+  interpreter.save_state(state.interpreter);
+  filled_slots |= 1u << slot;
+
+  if (to_disk) {
+    if (SaveSlotFile *file = open_disk_slot(slot, true)) {
+      file->write(state);
+    }
+  }
+
+  spdlog::info("Saved state to slot {}", slot);
+}
+
+void Emulator::load_slot(int slot, bool from_disk) {
+  if (slot < 0 || slot >= kSaveSlotCount) {
+    return;
+  }
+
+  save_state &state = slots[slot];
+  if (!(filled_slots & (1u << slot)) && from_disk) {
+    SaveSlotFile *file = open_disk_slot(slot, false);
+    if (file && file->read(state)) {
+      filled_slots |= 1u << slot;
+    }
+  }
+
+  if (!(filled_slots & (1u << slot))) {
+    spdlog::warn("Save slot {} is empty", slot);
+    return;
+  }
+
+  restore_state(state, false);
+  // history from before the load doesn't lead up to this state
+  rewind.clear();
+  capture_frame(true);
+
+  spdlog::info("Loaded state from slot {}", slot);
+}
+
+void Emulator::restore_state(const save_state &state, bool keep_playing) {
+  // the screen may differ even if the generation matches the last one drawn
+  uint32_t screen_generation = regs->screen_generation;
+  *regs = state.regs;
+  regs->screen_generation = screen_generation + 1;
+
+  if (keep_playing) {
+    interpreter_state resumed = state.interpreter;
+    resumed.playing = interpreter.is_playing();
+    interpreter.load_state(resumed);
+  } else {
+    interpreter.load_state(state.interpreter);
+  }
+}
+
+void Emulator::capture_frame(bool force) {
+  auto now = steady_clock::now();
+  if (!force && now - last_capture < duration<double>(1.0 / kRewindCaptureRate)) {
+    return;
+  }
+  last_capture = now;
+
+  frame_state.stamp();
+  frame_state.regs = *regs;
+  interpreter.save_state(frame_state.interpreter);
+  rewind.push(frame_state);
+}
+
+void Emulator::rewind_frames() {
+  // rewinds at the guest frame rate, one captured state per frame
+  rewind_pending += static_cast<double>(kTimerRate) / kEmulationTickRate;
+  while (rewind_pending >= 1.0) {
+    rewind_pending -= 1.0;
+    if (rewind.empty()) {
+      return;
+    }
+    // the machine usually ran past the latest state, go back to that first
+    if (interpreter.get_cycle() == rewind.latest_cycle() &&
+        !rewind.drop_latest()) {
+      return;
+    }
+    restore_state(rewind.latest(), true);
+  }
+}
+
+void Emulator::step_back() {
+  uint64_t cycle = interpreter.get_cycle();
+  if (cycle == 0 || rewind.empty()) {
+    return;
+  }
+
+  // restore the nearest state before the previous instruction and replay
+  // up to it, stepping captures new states along the way
+  uint64_t target = cycle - 1;
+  while (rewind.latest_cycle() > target) {
+    if (!rewind.drop_latest()) {
+      spdlog::warn("No rewind history left to step back into");
+      return;
+    }
+  }
+
+  restore_state(rewind.latest(), true);
+  while (interpreter.get_cycle() < target) {
+    interpreter.step();
+  }
+}
+
+SaveSlotFile *Emulator::open_disk_slot(int slot, bool create) {
+  SaveSlotFile &file = disk_slots[slot];
+  if (file.is_open()) {
+    return &file;
+  }
+
+  std::error_code err;
+  if (create) {
+    fs::create_directories(kSaveStateDirectory, err);
+  }
+  if (err) {
+    spdlog::error("Failed to create {}: {}", kSaveStateDirectory,
+                  err.message());
+    return nullptr;
+  }
+
+  fs::path path = fs::path(kSaveStateDirectory) /
+                  fmt::format("{:016x}-{}.state", rom_hash, slot);
+  return file.open(path.string(), create) ? &file : nullptr;
+}
+
+void Emulator::publish_state() {
+  emulator_state &state = states.write_buffer();
+  state.regs = *regs;
+  state.playing = interpreter.is_playing();
+  state.play_rate = interpreter.update_play_rate;
+  state.speed = static_cast<int>(interpreter.speed * 100.0 + 0.5);
+  state.unthrottled = interpreter.unthrottled;
+  state.max_catch_up_frames = interpreter.max_catch_up_frames;
+  state.stats = interpreter.get_stats();
+  state.backend = interpreter.get_backend();
+  state.save_slots = filled_slots;
+  state.rewinding = rewinding;
+  state.rewind_states = rewind.size();
+  state.rewind_bytes = rewind.bytes_used();
+  state.movie = movie_status;
+  state.seed = interpreter.get_seed();
+  states.publish();
+
+  shared_state.publish(*regs, interpreter.get_cycle(),
+                       interpreter.get_stats().frames,
+                       interpreter.is_playing());
+}
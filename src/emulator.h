@@ -0,0 +1,153 @@
+#pragma once
+
+#include "interpreter.h"
+#include "movie.h"
+#include "registers.h"
+#include "rewind.h"
+#include "save_state.h"
+#include "shared_state.h"
+#include "spsc_queue.h"
+#include "triple_buffer.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+constexpr int kEmulationTickRate = 240;
+constexpr size_t kCommandQueueSize = 256;
+// how long a paused emulator sleeps between checks if no command wakes it
+constexpr std::chrono::milliseconds kPausedWakeInterval{250};
+
+enum class emulator_command_type {
+  play,
+  stop,
+  step,
+  reset,
+  load_rom,
+  set_key,
+  write_memory,
+  set_delay_timer,
+  set_sound_timer,
+  flip_pixel,
+  set_play_rate,
+  set_speed,
+  set_unthrottled,
+  set_max_catch_up_frames,
+  set_backend,
+  // index non-zero to seed every reset with value, zero for fresh seeds
+  set_seed,
+  // index is the slot, value non-zero to also use the slot's file on disk
+  save_state,
+  load_state,
+  // value non-zero while rewind is held
+  set_rewinding,
+  step_back,
+  // restart the ROM and record input until stop_recording, which writes the
+  // movie to path unless it's empty
+  start_recording,
+  stop_recording,
+  // restart the ROM and replay the movie at path
+  start_replay,
+  stop_replay,
+  // publish the machine to the shared memory segment named path, or stop
+  // publishing when path is empty
+  share_state,
+};
+
+struct emulator_command {
+  emulator_command_type type = emulator_command_type::stop;
+  // key number, memory address or pixel index depending on type
+  int index = 0;
+  int value = 0;
+  std::vector<uint8_t> data;
+  std::string path;
+};
+
+struct emulator_state {
+  registers regs;
+  bool playing = false;
+  int play_rate = kDefaultPlayingUpdateRate;
+  // percent of real time
+  int speed = 100;
+  bool unthrottled = false;
+  int max_catch_up_frames = kDefaultMaxCatchUpFrames;
+  scheduler_stats stats;
+  backend_type backend = backend_type::interpreter;
+  // bit per save slot holding a state in memory
+  uint32_t save_slots = 0;
+  bool rewinding = false;
+  size_t rewind_states = 0;
+  size_t rewind_bytes = 0;
+  movie_mode movie = movie_mode::none;
+  uint32_t seed = 0;
+};
+
+// Runs the interpreter on its own thread at a fixed tick rate. The UI reads
+// the latest published state and talks back through a command queue.
+class Emulator {
+public:
+  Emulator();
+  ~Emulator();
+
+  void initialize();
+  void cleanup();
+
+  void send(emulator_command command);
+  // valid until the next call, read it once per frame
+  const emulator_state &get_state();
+
+private:
+  void run();
+  void handle_command(emulator_command &command);
+  void publish_state();
+  void save_slot(int slot, bool to_disk);
+  void load_slot(int slot, bool from_disk);
+  SaveSlotFile *open_disk_slot(int slot, bool create);
+  void restore_state(const save_state &state, bool keep_playing);
+  void capture_frame(bool force);
+  void rewind_frames();
+  void step_back();
+  void restart_for_movie(std::optional<uint32_t> seed, int play_rate);
+  void stop_movie();
+  void feed_input(uint64_t cycle);
+  void feed_shared_input();
+
+  std::shared_ptr<registers> regs;
+  Interpreter interpreter;
+  std::vector<uint8_t> rom;
+  // names the on-disk slots so states stay with the ROM they came from
+  uint64_t rom_hash = 0;
+
+  std::array<save_state, kSaveSlotCount> slots{};
+  std::array<SaveSlotFile, kSaveSlotCount> disk_slots;
+  uint32_t filled_slots = 0;
+
+  RewindBuffer rewind;
+  save_state frame_state{};
+  std::chrono::steady_clock::time_point last_capture;
+  bool rewinding = false;
+  bool resume_playing = false;
+  // fractional frames owed to rewinding at the guest frame rate
+  double rewind_pending = 0;
+
+  std::optional<uint32_t> fixed_seed;
+
+  movie_mode movie_status = movie_mode::none;
+  MovieRecorder recorder;
+  MoviePlayer player;
+
+  SharedStateExport shared_state;
+
+  SpscQueue<emulator_command, kCommandQueueSize> commands;
+  TripleBuffer<emulator_state> states;
+  std::thread thread;
+  std::atomic<bool> running{false};
+  std::mutex wake_mutex;
+  std::condition_variable wake;
+};
@@ -0,0 +1,60 @@
+#include "fork.h"
+
+#include <algorithm>
+
+namespace {
+
+const std::shared_ptr<memory_page_table> &zero_pages() {
+  static const auto table = [] {
+    auto page = std::make_shared<memory_page>();
+    auto pages = std::make_shared<memory_page_table>();
+    pages->fill(page);
+    return pages;
+  }();
+  return table;
+}
+
+} // namespace
+
+MachineFork::MachineFork() : pages(zero_pages()) {}
+
+uint8_t MachineFork::read(uint16_t addr) const {
+  addr &= kMemSize - 1;
+  return (*(*pages)[addr / kMemPageSize])[addr % kMemPageSize];
+}
+
+void MachineFork::write(uint16_t addr, uint8_t val) {
+  addr &= kMemSize - 1;
+  if (pages.use_count() > 1) {
+    pages = std::make_shared<memory_page_table>(*pages);
+  }
+  // a page only just copied out of a shared table is still shared
+  std::shared_ptr<memory_page> &page = (*pages)[addr / kMemPageSize];
+  if (page.use_count() > 1) {
+    page = std::make_shared<memory_page>(*page);
+  }
+  (*page)[addr % kMemPageSize] = val;
+}
+
+const memory_page &MachineFork::page(int index) const {
+  return *(*pages)[index];
+}
+
+bool MachineFork::shares_page(int index, const MachineFork &other) const {
+  return (*pages)[index] == (*other.pages)[index];
+}
+
+void MachineFork::get_registers(registers &out) const {
+  out.pc = pc;
+  out.i = i;
+  out.dt = dt;
+  out.st = st;
+  out.v = v;
+  out.kbd = kbd;
+  out.screen = screen;
+  out.screen_generation += 1;
+  for (int index = 0; index < kMemPageCount; index += 1) {
+    const memory_page &src = page(index);
+    std::copy(src.begin(), src.end(), out.mem.begin() + index * kMemPageSize);
+  }
+}
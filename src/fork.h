@@ -0,0 +1,45 @@
+#pragma once
+
+#include "interpreter.h"
+#include "registers.h"
+
+#include <array>
+#include <cstdint>
+#include <memory>
+
+// A machine frozen at one point and cheap to copy. The register file, keypad
+// and framebuffer are held by value, memory as a refcounted table of
+// refcounted pages shared with every copy. Copying a MachineFork forks it:
+// nothing in memory is copied until one side writes to a shared page, which
+// then gets a private copy.
+//
+// Pages are never changed while shared, so forks can be resumed on other
+// threads.
+class MachineFork {
+public:
+  MachineFork();
+
+  uint16_t pc = 0;
+  uint16_t i = 0;
+  uint8_t dt = 0;
+  uint8_t st = 0;
+  std::array<uint8_t, kGeneralRegisterCount> v{0};
+  std::array<bool, kKeyboardSize> kbd{false};
+  std::array<screen_row, kScreenHeight> screen{0};
+  interpreter_state interpreter;
+
+  uint8_t read(uint16_t addr) const;
+  void write(uint16_t addr, uint8_t val);
+
+  const memory_page &page(int index) const;
+  // true while both still see the same copy of the page
+  bool shares_page(int index, const MachineFork &other) const;
+
+  // the whole machine in the layout the rest of the emulator uses
+  void get_registers(registers &out) const;
+
+private:
+  friend class Interpreter;
+
+  std::shared_ptr<memory_page_table> pages;
+};
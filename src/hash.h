@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+constexpr uint64_t kHashOffsetBasis = 0xcbf29ce484222325;
+
+// FNV-1a, stable across runs, builds and platforms. Chain calls by passing
+// the previous result as hash.
+inline uint64_t hash_bytes(const void *data, size_t size,
+                           uint64_t hash = kHashOffsetBasis) {
+  const uint8_t *bytes = static_cast<const uint8_t *>(data);
+  for (size_t idx = 0; idx < size; idx += 1) {
+    hash = (hash ^ bytes[idx]) * 0x100000001b3;
+  }
+  return hash;
+}
@@ -0,0 +1,258 @@
+#include "headless.h"
+#include "hash.h"
+#include "movie.h"
+#include "timer.h"
+
+#include <algorithm>
+#include <array>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <spdlog/spdlog.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// Appends val most significant byte first, as PNG wants
+void put_u32_be(std::vector<uint8_t> &out, uint32_t val) {
+  for (int shift = 24; shift >= 0; shift -= 8) {
+    out.push_back((val >> shift) & 0xff);
+  }
+}
+
+uint32_t crc32(const uint8_t *data, size_t size) {
+  static const std::array<uint32_t, 256> table = [] {
+    std::array<uint32_t, 256> entries{};
+    for (uint32_t n = 0; n < 256; n += 1) {
+      uint32_t c = n;
+      for (int k = 0; k < 8; k += 1) {
+        c = (c & 1) ? 0xedb88320 ^ (c >> 1) : c >> 1;
+      }
+      entries[n] = c;
+    }
+    return entries;
+  }();
+
+  uint32_t crc = 0xffffffff;
+  for (size_t idx = 0; idx < size; idx += 1) {
+    crc = table[(crc ^ data[idx]) & 0xff] ^ (crc >> 8);
+  }
+  return crc ^ 0xffffffff;
+}
+
+void put_png_chunk(std::vector<uint8_t> &out, const char *type,
+                   const std::vector<uint8_t> &data) {
+  put_u32_be(out, data.size());
+  size_t start = out.size();
+  out.insert(out.end(), type, type + 4);
+  out.insert(out.end(), data.begin(), data.end());
+  put_u32_be(out, crc32(out.data() + start, out.size() - start));
+}
+
+// Rows of packed 1-bit pixels, leftmost pixel in the high bit
+std::vector<uint8_t> pack_rows(const registers &regs, bool lit_bit) {
+  std::vector<uint8_t> rows;
+  for (screen_row row : regs.screen) {
+    if (!lit_bit) {
+      row = ~row;
+    }
+    for (int shift = kScreenWidth - 8; shift >= 0; shift -= 8) {
+      rows.push_back((row >> shift) & 0xff);
+    }
+  }
+  return rows;
+}
+
+std::vector<uint8_t> encode_pbm(const registers &regs) {
+  std::string header = fmt::format("P4\n{} {}\n", kScreenWidth, kScreenHeight);
+  std::vector<uint8_t> out(header.begin(), header.end());
+  // PBM draws set bits in black
+  std::vector<uint8_t> rows = pack_rows(regs, false);
+  out.insert(out.end(), rows.begin(), rows.end());
+  return out;
+}
+
+// A 1-bit grayscale PNG. The image is tiny, so the zlib stream holds a single
+// stored block and needs no compressor.
+std::vector<uint8_t> encode_png(const registers &regs) {
+  const int row_bytes = kScreenWidth / 8;
+  std::vector<uint8_t> rows = pack_rows(regs, true);
+
+  std::vector<uint8_t> raw;
+  for (int y = 0; y < kScreenHeight; y += 1) {
+    // filter type none
+    raw.push_back(0);
+    raw.insert(raw.end(), rows.begin() + y * row_bytes,
+               rows.begin() + (y + 1) * row_bytes);
+  }
+
+  uint32_t a = 1;
+  uint32_t b = 0;
+  for (uint8_t byte : raw) {
+    a = (a + byte) % 65521;
+    b = (b + a) % 65521;
+  }
+
+  std::vector<uint8_t> idat = {0x78, 0x01, 0x01};
+  uint16_t len = raw.size();
+  idat.push_back(len & 0xff);
+  idat.push_back(len >> 8);
+  idat.push_back(~len & 0xff);
+  idat.push_back((~len >> 8) & 0xff);
+  idat.insert(idat.end(), raw.begin(), raw.end());
+  put_u32_be(idat, (b << 16) | a);
+
+  std::vector<uint8_t> ihdr;
+  put_u32_be(ihdr, kScreenWidth);
+  put_u32_be(ihdr, kScreenHeight);
+  // bit depth 1, grayscale, deflate, adaptive filtering, no interlace
+  ihdr.insert(ihdr.end(), {1, 0, 0, 0, 0});
+
+  std::vector<uint8_t> out = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+  put_png_chunk(out, "IHDR", ihdr);
+  put_png_chunk(out, "IDAT", idat);
+  put_png_chunk(out, "IEND", {});
+  return out;
+}
+
+} // namespace
+
+tl::expected<std::vector<uint8_t>, std::string>
+read_rom(const std::string &path) {
+  std::ifstream in(path, std::ios::binary);
+  if (!in) {
+    return tl::unexpected(fmt::format("failed to open {}", path));
+  }
+  std::vector<uint8_t> rom = {std::istreambuf_iterator<char>(in), {}};
+  if (rom.size() > kMemSize - kRomStartIndex) {
+    return tl::unexpected(fmt::format("{} exceeds memory size", path));
+  }
+  return rom;
+}
+
+uint64_t hash_machine_state(const registers &regs) {
+  // field by field, padding and the UI-facing screen_generation stay out
+  uint64_t hash = hash_bytes(&regs.pc, sizeof(regs.pc));
+  hash = hash_bytes(&regs.i, sizeof(regs.i), hash);
+  hash = hash_bytes(&regs.dt, sizeof(regs.dt), hash);
+  hash = hash_bytes(&regs.st, sizeof(regs.st), hash);
+  hash = hash_bytes(regs.v.data(), regs.v.size(), hash);
+  hash = hash_bytes(regs.mem.data(), regs.mem.size(), hash);
+  for (screen_row row : regs.screen) {
+    for (int shift = kScreenWidth - 8; shift >= 0; shift -= 8) {
+      uint8_t byte = (row >> shift) & 0xff;
+      hash = hash_bytes(&byte, 1, hash);
+    }
+  }
+  return hash;
+}
+
+tl::expected<void, std::string> write_screen_image(const registers &regs,
+                                                   const std::string &path) {
+  std::string ext = fs::path(path).extension().string();
+  std::transform(ext.begin(), ext.end(), ext.begin(),
+                 [](unsigned char c) { return std::tolower(c); });
+
+  std::vector<uint8_t> bytes;
+  if (ext == ".pbm") {
+    bytes = encode_pbm(regs);
+  } else if (ext == ".png") {
+    bytes = encode_png(regs);
+  } else {
+    return tl::unexpected(
+        fmt::format("unsupported image format \"{}\", use .pbm or .png", ext));
+  }
+
+  std::ofstream file(path, std::ios::binary);
+  file.write(reinterpret_cast<const char *>(bytes.data()), bytes.size());
+  if (!file) {
+    return tl::unexpected(fmt::format("failed to write {}", path));
+  }
+  return {};
+}
+
+tl::expected<headless_result, std::string>
+run_headless(const headless_options &options, registers &regs) {
+  auto rom = read_rom(options.rom_path);
+  if (!rom) {
+    return tl::unexpected(rom.error());
+  }
+
+  std::optional<uint32_t> seed = options.seed;
+  int play_rate = options.play_rate;
+  uint64_t target = options.instructions;
+
+  MoviePlayer player;
+  bool replaying = !options.movie_path.empty();
+  if (replaying) {
+    auto replay = movie::load(options.movie_path);
+    if (!replay) {
+      return tl::unexpected(replay.error());
+    }
+    if (replay->rom_hash != hash_bytes(rom->data(), rom->size())) {
+      spdlog::warn("Movie was recorded with a different ROM");
+    }
+    // the movie decides everything that affects guest timing
+    seed = replay->seed;
+    play_rate = replay->play_rate;
+    if (options.frames == 0 && options.instructions == 0) {
+      target = replay->end_cycle;
+    }
+    player.start(std::move(replay.value()));
+  }
+
+  if (options.frames == 0 && target == 0) {
+    return tl::unexpected(
+        std::string("nothing to run, give a frame or instruction count"));
+  }
+
+  auto shared = std::make_shared<registers>();
+  Interpreter interpreter(shared);
+  interpreter.update_play_rate = std::max(play_rate, 1);
+  interpreter.set_backend(options.backend);
+  interpreter.set_seed(seed);
+  interpreter.initialize();
+  interpreter.load_rom_bytes(rom.value());
+  if (replaying) {
+    interpreter.set_input_callback(
+        [&](uint64_t cycle) { player.apply(cycle, shared->kbd); });
+  }
+
+  Timer timer;
+  if (options.frames > 0) {
+    uint64_t frames = 0;
+    while (frames < options.frames) {
+      int batch = static_cast<int>(
+          std::min<uint64_t>(options.frames - frames, kMaxElidedFrames));
+      frames += interpreter.run_frames(batch);
+    }
+  } else {
+    // whole frames while they fit, so DT waits can still be elided, then
+    // single instructions up to the exact count
+    const uint64_t frame_length = interpreter.update_play_rate / kTimerRate + 1;
+    while (interpreter.get_cycle() + frame_length <= target) {
+      uint64_t fit = (target - interpreter.get_cycle()) / frame_length;
+      interpreter.run_frames(
+          static_cast<int>(std::min<uint64_t>(fit, kMaxElidedFrames)));
+    }
+    while (interpreter.get_cycle() < target) {
+      interpreter.step();
+    }
+  }
+
+  headless_result result;
+  result.seconds = timer.duration();
+  const scheduler_stats &stats = interpreter.get_stats();
+  result.frames = stats.frames;
+  // elided DT waits and idle loops pass guest time without running anything
+  result.instructions = stats.instructions - stats.idle_instructions;
+  result.cycles = interpreter.get_cycle();
+  result.seed = interpreter.get_seed();
+  result.state_hash = hash_machine_state(*shared);
+  regs = *shared;
+
+  interpreter.cleanup();
+  return result;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "interpreter.h"
+#include "registers.h"
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <tl/expected.hpp>
+#include <vector>
+
+struct headless_options {
+  std::string rom_path;
+  backend_type backend = backend_type::interpreter;
+  std::optional<uint32_t> seed;
+  int play_rate = kDefaultPlayingUpdateRate;
+  // how long to run, in guest frames or instructions. A movie without either
+  // runs to its end.
+  uint64_t frames = 0;
+  uint64_t instructions = 0;
+  std::string movie_path;
+};
+
+struct headless_result {
+  uint64_t frames = 0;
+  // instructions actually executed, without the ones skipped as idle
+  uint64_t instructions = 0;
+  // guest instruction slots elapsed, executed or skipped
+  uint64_t cycles = 0;
+  double seconds = 0;
+  uint32_t seed = 0;
+  uint64_t state_hash = 0;
+};
+
+// Runs a ROM with nothing but the core: no window, audio or UI, as fast as
+// the host allows. The final machine state is left in regs.
+tl::expected<headless_result, std::string>
+run_headless(const headless_options &options, registers &regs);
+
+tl::expected<std::vector<uint8_t>, std::string>
+read_rom(const std::string &path);
+
+// Hash of everything the guest can observe, equal across runs that ended in
+// the same state.
+uint64_t hash_machine_state(const registers &regs);
+
+// Writes the framebuffer with lit pixels in white, as a binary PBM or a
+// grayscale PNG depending on the extension of path.
+tl::expected<void, std::string> write_screen_image(const registers &regs,
+                                                   const std::string &path);
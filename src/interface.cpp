@@ -15,7 +15,6 @@
 #include <fstream>
 #include <imgui.h>
 #include <imgui_internal.h>
-#include <mach_debug/zone_info.h>
 #include <memory>
 #include <mutex>
 #include <nfd.h>
@@ -26,9 +25,12 @@
 namespace fs = std::filesystem;
 
 constexpr int kDefaultFPS = 60;
-constexpr int kDefaultScreenPixelSize = 4;
 constexpr int kDefaultWindowWidth = 1200;
 constexpr int kDefaultWindowHeight = 800;
+// while fast-forwarding only every Nth UI frame is drawn
+constexpr int kTurboRenderInterval = 8;
+// keep redrawing at the frame rate this long after the last input while paused
+constexpr double kEventWaitDelay = 0.5;
 
 const char* const kWindowTitle = "CHIP-8";
 const char* const kSettingsFile = "settings.toml";
@@ -37,6 +39,16 @@ static bool should_close = false;
 static bool init_dock = true;
 static bool rom_loaded = false;
 static bool force_play_all_sounds = false;
+static bool unthrottled = false;
+static bool turbo_toggled = false;
+static bool turbo_active = false;
+static uint64_t turbo_frame = 0;
+static bool waiting_for_events = false;
+static double last_active_time = 0;
+static int selected_slot = 0;
+static bool rewind_button_held = false;
+static bool rewind_active = false;
+static Emulator *mem_editor_emulator = nullptr;
 
 static float square(float val) {
   if (val > 0) {
@@ -64,7 +76,14 @@ static void deserialize_settings(const toml::table &table, interface_settings &s
   settings.show_keyboard = table["view"]["keyboard"].value_or(settings.show_keyboard);
   settings.show_audio = table["view"]["audio"].value_or(settings.show_audio);
   settings.show_timers = table["view"]["timers"].value_or(settings.show_timers);
-  settings.auto_play = table["emulation"]["autoplay"].value_or(settings.auto_play);
+  settings.show_profiler = table["view"]["profiler"].value_or(settings.show_profiler);
+  // earlier builds wrote these under a misspelled table, still pick them up
+  // from there until the settings are saved again
+  auto emulation = table["emulation"].is_table() ? table["emulation"] : table["emilation"];
+  settings.auto_play = emulation["autoplay"].value_or(settings.auto_play);
+  settings.persist_states = emulation["persist_states"].value_or(settings.persist_states);
+  settings.use_seed = emulation["use_seed"].value_or(settings.use_seed);
+  settings.seed = emulation["seed"].value_or(settings.seed);
 }
 
 static void serialize_settings(const interface_settings &settings, toml::table &table) {
@@ -102,13 +121,18 @@ static void serialize_settings(const interface_settings &settings, toml::table &
   view.insert_or_assign("keyboard", settings.show_keyboard);
   view.insert_or_assign("audio", settings.show_audio);
   view.insert_or_assign("timers", settings.show_timers);
+  view.insert_or_assign("profiler", settings.show_profiler);
 
-  toml::table& emulation = sub_table(table, "emilation");
+  table.erase("emilation");
+  toml::table& emulation = sub_table(table, "emulation");
   emulation.insert_or_assign("autoplay", settings.auto_play);
+  emulation.insert_or_assign("persist_states", settings.persist_states);
+  emulation.insert_or_assign("use_seed", settings.use_seed);
+  emulation.insert_or_assign("seed", static_cast<int64_t>(settings.seed));
 }
 
-Interface::Interface(std::shared_ptr<registers> regs, Interpreter *interpreter)
-    : interpreter{interpreter}, regs(std::move(regs)) {}
+Interface::Interface(Emulator *emulator)
+    : emulator{emulator}, regs(std::make_shared<registers>()) {}
 
 void Interface::initialize() {
   config.settings.reset();
@@ -160,6 +184,13 @@ void Interface::initialize() {
 
   mem_editor.Cols = 8;
 
+  mem_editor_emulator = emulator;
+  mem_editor.WriteFn = [](ImU8 *data, size_t off, ImU8 d) {
+    data[off] = d;
+    mem_editor_emulator->send({emulator_command_type::write_memory,
+                               static_cast<int>(off), d});
+  };
+
   auto level = spdlog::get_level();
 
   auto console_sink = std::make_shared<spdlog::sinks::stdout_color_sink_mt>();
@@ -184,16 +215,20 @@ void Interface::initialize() {
   spdlog::set_default_logger(logger);
   spdlog::info("Initialized interface");
 
-  screen.initialize(kScreenWidth, kScreenHeight, kDefaultScreenPixelSize,
-                    regs->screen.data());
-  assembly.initialize(regs.get());
+  screen.initialize(regs.get());
+  assembly.initialize(instructions_panel.get_registers());
 
-  keyboard.initialize(regs);
+  keyboard.initialize(regs, emulator);
+
+  emulator->send({emulator_command_type::set_seed, config.settings.use_seed,
+                  static_cast<int>(config.settings.seed)});
 }
 
 bool Interface::update() {
   interface_settings &settings = config.settings;
 
+  frame_timer.reset();
+
   if (IsFileDropped()) {
     FilePathList droppedFiles = LoadDroppedFiles();
     if (droppedFiles.count > 0) {
@@ -218,10 +253,103 @@ bool Interface::update() {
     UnloadDroppedFiles(droppedFiles);
   }
 
+  // the only read of the frame, a second one may hand this buffer back to
+  // the emulation thread while it is still in use
+  const emulator_state &state = emulator->get_state();
+  *regs = state.regs;
+
+  // idle share and speed of guest time over the last second
+  static scheduler_stats stats_sample;
+  static double stats_sample_time = 0;
+  static float idle_percent = 0;
+  static float speed_multiplier = 0;
+  if (state.stats.instructions < stats_sample.instructions) {
+    // emulator was reset
+    stats_sample = {};
+  }
+  if (double elapsed = GetTime() - stats_sample_time; elapsed >= 1.0) {
+    uint64_t instructions = state.stats.instructions - stats_sample.instructions;
+    uint64_t idle = state.stats.idle_instructions - stats_sample.idle_instructions;
+    uint64_t frames = state.stats.frames - stats_sample.frames;
+    idle_percent = instructions > 0 ? 100.0f * idle / instructions : 0.0f;
+    speed_multiplier = frames / (elapsed * kTimerRate);
+    stats_sample = state.stats;
+    stats_sample_time = GetTime();
+  }
+
   keyboard.update();
 
+  // F5 saves and F9 loads the selected slot, F6 and F7 change the slot
+  if (IsKeyPressed(KEY_F6)) {
+    selected_slot = (selected_slot + kSaveSlotCount - 1) % kSaveSlotCount;
+    spdlog::info("Selected save slot {}", selected_slot);
+  }
+  if (IsKeyPressed(KEY_F7)) {
+    selected_slot = (selected_slot + 1) % kSaveSlotCount;
+    spdlog::info("Selected save slot {}", selected_slot);
+  }
+  if (IsKeyPressed(KEY_F5)) {
+    save_to_slot(selected_slot);
+  }
+  if (IsKeyPressed(KEY_F9)) {
+    load_from_slot(selected_slot);
+  }
+
+  // fast-forward while tab is held or turbo is toggled on
+  bool turbo = turbo_toggled || IsKeyDown(KEY_TAB);
+  if (turbo != turbo_active) {
+    turbo_active = turbo;
+    emulator->send({emulator_command_type::set_unthrottled, 0,
+                    turbo_active || unthrottled});
+  }
+
+  // rewind while backspace or the rewind button is held
+  bool rewind = rom_loaded && (rewind_button_held || IsKeyDown(KEY_BACKSPACE));
+  if (rewind != rewind_active) {
+    rewind_active = rewind;
+    emulator->send({emulator_command_type::set_rewinding, 0, rewind_active});
+  }
+
   bool is_playing = regs->st > 0;
-  sounds.update(is_playing || force_play_all_sounds);
+  sounds.update(!turbo_active && (is_playing || force_play_all_sounds));
+
+  if (turbo_active && turbo_frame++ % kTurboRenderInterval != 0) {
+    PollInputEvents();
+    WaitTime(1.0 / kDefaultFPS);
+    return WindowShouldClose() || should_close;
+  }
+
+  // nothing changes on screen while paused unless there was input, so sleep in
+  // EndDrawing until the next event instead of redrawing every frame
+  double now = GetTime();
+  if (state.playing || state.rewinding || turbo_active || waiting_for_events) {
+    last_active_time = now;
+  }
+  bool should_wait = now - last_active_time > kEventWaitDelay;
+  if (should_wait != waiting_for_events) {
+    waiting_for_events = should_wait;
+    if (waiting_for_events) {
+      spdlog::trace("Waiting for events");
+      EnableEventWaiting();
+    } else {
+      DisableEventWaiting();
+    }
+  }
+
+  static int redraw_count = 0;
+  static double redraw_time = 0;
+  static float redraw_rate = 0;
+  redraw_count += 1;
+  if (double elapsed = now - redraw_time; elapsed >= 1.0) {
+    redraw_rate = redraw_count / elapsed;
+    redraw_count = 0;
+    redraw_time = now;
+  }
+
+  for (PanelRefresh *panel :
+       {&registers_panel, &memory_panel, &instructions_panel, &timers_panel}) {
+    panel->update(*regs, state.playing, now);
+  }
 
   screen.update();
 
@@ -267,13 +395,15 @@ bool Interface::update() {
     ImGui::DockBuilderFinish(dockspace_id);
   }
 
-  render_main_menu();
+  render_main_menu(state);
 
   if (settings.show_demo) {
     ImGui::ShowDemoWindow(&settings.show_demo);
   }
 
   if (settings.show_registers) {
+    registers_panel.begin_profile();
+    const registers *panel_regs = registers_panel.get_registers();
     if (ImGui::Begin("Registers", &settings.show_registers)) {
       ImGui::BeginTable("general_registers", 4, ImGuiTableFlags_Borders);
       {
@@ -289,8 +419,8 @@ bool Interface::update() {
             ImGui::Text("v%X", idx);
             ImGui::PopStyleColor();
 
-            ImGui::Text("0x%02x", regs->v[idx]);
-            ImGui::Text("%04d", regs->v[idx]);
+            ImGui::Text("0x%02x", panel_regs->v[idx]);
+            ImGui::Text("%04d", panel_regs->v[idx]);
           }
         }
       }
@@ -306,8 +436,8 @@ bool Interface::update() {
           ImGui::Text("PC");
           ImGui::PopStyleColor();
 
-          ImGui::Text("0x%02x", regs->pc);
-          ImGui::Text("%04d", regs->pc);
+          ImGui::Text("0x%02x", panel_regs->pc);
+          ImGui::Text("%04d", panel_regs->pc);
         }
 
         ImGui::TableNextColumn();
@@ -316,8 +446,8 @@ bool Interface::update() {
           ImGui::Text("I");
           ImGui::PopStyleColor();
 
-          ImGui::Text("0x%02x", regs->i);
-          ImGui::Text("%04d", regs->i);
+          ImGui::Text("0x%02x", panel_regs->i);
+          ImGui::Text("%04d", panel_regs->i);
         }
 
         ImGui::TableNextColumn();
@@ -326,8 +456,8 @@ bool Interface::update() {
           ImGui::Text("DT");
           ImGui::PopStyleColor();
 
-          ImGui::Text("0x%02x", regs->dt);
-          ImGui::Text("%04d", regs->dt);
+          ImGui::Text("0x%02x", panel_regs->dt);
+          ImGui::Text("%04d", panel_regs->dt);
         }
 
         ImGui::TableNextColumn();
@@ -336,13 +466,14 @@ bool Interface::update() {
           ImGui::Text("ST");
           ImGui::PopStyleColor();
 
-          ImGui::Text("0x%02x", regs->st);
-          ImGui::Text("%04d", regs->st);
+          ImGui::Text("0x%02x", panel_regs->st);
+          ImGui::Text("%04d", panel_regs->st);
         }
       }
       ImGui::EndTable();
     }
     ImGui::End();
+    registers_panel.end_profile();
   }
 
   if (settings.show_misc) {
@@ -360,13 +491,13 @@ bool Interface::update() {
 
       static int sound_val;
       if (ImGui::Button("Play Sound")) {
-        regs->st = sound_val;
+        emulator->send({emulator_command_type::set_sound_timer, 0, sound_val});
       }
       ImGui::SameLine();
       ImGui::SliderInt("##Sound Val", &sound_val, 1, 255);
 
       if (ImGui::Button("Stop Sound")) {
-        regs->st = 0;
+        emulator->send({emulator_command_type::set_sound_timer, 0, 0});
       }
 
       if (ImGui::Button("Open file")) {
@@ -374,16 +505,54 @@ bool Interface::update() {
       }
 
       static int random_pixel_count = 1;
+      static Random pixel_random(make_random_seed());
       if (ImGui::Button("Toggle Random Pixel")) {
         for (int i = 0; i < random_pixel_count; i += 1) {
-          uint8_t x = random_byte() % kScreenWidth;
-          uint8_t y = random_byte() % kScreenHeight;
-          int idx = (y * kScreenWidth) + x;
-          regs->screen[idx] = !regs->screen[idx];
+          uint8_t x = pixel_random.next_byte() % kScreenWidth;
+          uint8_t y = pixel_random.next_byte() % kScreenHeight;
+          emulator->send({emulator_command_type::flip_pixel,
+                          y * kScreenWidth + x});
         }
       }
       ImGui::SameLine();
       ImGui::SliderInt("##Pixel Count", &random_pixel_count, 1, 100);
+
+      int speed = state.speed;
+      if (ImGui::SliderInt("Speed %", &speed, 10, 1000)) {
+        emulator->send({emulator_command_type::set_speed, 0, speed});
+      }
+
+      bool seed_changed = ImGui::Checkbox("Fixed Seed", &settings.use_seed);
+      ImGui::SameLine();
+      seed_changed |= ImGui::InputScalar("Seed", ImGuiDataType_U32, &settings.seed);
+      if (seed_changed) {
+        // takes effect on the next reset
+        emulator->send({emulator_command_type::set_seed, settings.use_seed,
+                        static_cast<int>(settings.seed)});
+      }
+      ImGui::Text("Current seed: %u", state.seed);
+
+      int max_catch_up_frames = state.max_catch_up_frames;
+      if (ImGui::SliderInt("Max Catch-up Frames", &max_catch_up_frames, 1, 60)) {
+        emulator->send({emulator_command_type::set_max_catch_up_frames, 0,
+                        max_catch_up_frames});
+      }
+
+      ImGui::Text("Idle: %.1f%%, speed: %.1fx", idle_percent, speed_multiplier);
+
+      ImGui::Text("Guest frames: %llu, instructions: %llu, dropped: %llu, "
+                  "elided: %llu",
+                  static_cast<unsigned long long>(state.stats.frames),
+                  static_cast<unsigned long long>(state.stats.instructions),
+                  static_cast<unsigned long long>(state.stats.dropped_frames),
+                  static_cast<unsigned long long>(state.stats.elided_frames));
+
+      ImGui::Text("Rewind: %zu states, %.1f KB", state.rewind_states,
+                  state.rewind_bytes / 1024.0);
+
+      ImGui::Text("Screen frames: %llu presented, %llu skipped",
+                  static_cast<unsigned long long>(screen.get_presented_frames()),
+                  static_cast<unsigned long long>(screen.get_skipped_frames()));
     }
     ImGui::End();
   }
@@ -404,7 +573,7 @@ bool Interface::update() {
 
       ImVec2 size = ImGui::GetWindowSize();
       ImVec2 frame_padding{16.0f, 8.0f};
-      float num_buttons = 4.0f;
+      float num_buttons = 6.0f;
       float button_width = ImGui::CalcTextSize(ICON_FA_PLAY).x;
       float buttons_width =
           (button_width + (2 * frame_padding.x) + style.ItemSpacing.x) *
@@ -416,14 +585,14 @@ bool Interface::update() {
       ImGui::PushStyleVar(ImGuiStyleVar_FramePadding, frame_padding);
       ImGui::PushStyleVar(ImGuiStyleVar_FrameRounding, 4.0f);
 
-      bool is_playing = interpreter->is_playing();
+      bool is_playing = state.playing;
 
       if (!rom_loaded || is_playing) {
         push_disabled_btn_flags();
       }
 
       if (ImGui::Button(ICON_FA_PLAY)) {
-        interpreter->play();
+        emulator->send({emulator_command_type::play});
       }
 
       if (!rom_loaded || is_playing) {
@@ -437,7 +606,7 @@ bool Interface::update() {
       }
 
       if (ImGui::Button(ICON_FA_PAUSE)) {
-        interpreter->stop();
+        emulator->send({emulator_command_type::stop});
       }
 
       if (!rom_loaded || !is_playing) {
@@ -450,19 +619,25 @@ bool Interface::update() {
         push_disabled_btn_flags();
       }
 
+      ImGui::Button(ICON_FA_BACKWARD);
+      rewind_button_held = ImGui::IsItemActive();
+
+      ImGui::SameLine();
+
       ImGui::PushButtonRepeat(true);
+      if (ImGui::Button(ICON_FA_BACKWARD_STEP)) {
+        emulator->send({emulator_command_type::step_back});
+      }
+      ImGui::SameLine();
       if (ImGui::Button(ICON_FA_FORWARD_STEP)) {
-        spdlog::debug("Single step");
-        interpreter->step();
+        emulator->send({emulator_command_type::step});
       }
       ImGui::PopButtonRepeat();
 
       ImGui::SameLine();
 
       if (ImGui::Button(ICON_FA_STOP)) {
-        interpreter->stop();
-        interpreter->reset();
-        interpreter->load_rom_bytes(rom);
+        emulator->send({emulator_command_type::reset});
       }
 
       if (!rom_loaded) {
@@ -475,7 +650,23 @@ bool Interface::update() {
 
       ImGui::SetNextItemWidth(slider_width);
       ImGui::SetCursorPosY(32);
-      ImGui::SliderInt("IPS", &interpreter->update_play_rate, 10, 3200);
+      int play_rate = state.play_rate;
+      if (ImGui::SliderInt("IPS", &play_rate, 10, 3200)) {
+        emulator->send({emulator_command_type::set_play_rate, 0, play_rate});
+      }
+
+      ImGui::SameLine();
+
+      const char *backends[] = {"Interpreter", "Recompiler"};
+      int backend = static_cast<int>(state.backend);
+      ImGui::SetNextItemWidth(128.0f);
+      if (ImGui::Combo("Backend", &backend, backends, IM_ARRAYSIZE(backends))) {
+        emulator->send({emulator_command_type::set_backend, 0, backend});
+      }
+
+      ImGui::SameLine();
+
+      ImGui::Checkbox("Turbo", &turbo_toggled);
     }
     ImGui::End();
   }
@@ -488,17 +679,22 @@ bool Interface::update() {
   }
 
   if (settings.show_memory) {
+    memory_panel.begin_profile();
     if (ImGui::Begin("Memory", &settings.show_memory)) {
-      mem_editor.DrawContents(regs->mem.data(), regs->mem.size());
+      registers *panel_regs = memory_panel.get_registers();
+      mem_editor.DrawContents(panel_regs->mem.data(), panel_regs->mem.size());
     }
     ImGui::End();
+    memory_panel.end_profile();
   }
 
   if (settings.show_instructions) {
+    instructions_panel.begin_profile();
     if (ImGui::Begin("Instructions", &settings.show_instructions)) {
       assembly.draw();
     }
     ImGui::End();
+    instructions_panel.end_profile();
   }
 
   if (settings.show_logs) {
@@ -550,52 +746,92 @@ bool Interface::update() {
   }
 
   if (settings.show_timers) {
+    timers_panel.begin_profile();
+    const registers *panel_regs = timers_panel.get_registers();
     if (ImGui::Begin("Timer", &settings.show_timers)) {
       ImGui::PushID("dt");
-      float delay_progress = static_cast<float>(regs->dt) / 255.0;
-      ImGui::ProgressBar(delay_progress, ImVec2(0.f, 0.f), fmt::format("{} / 255", regs->dt).c_str());
+      float delay_progress = static_cast<float>(panel_regs->dt) / 255.0;
+      ImGui::ProgressBar(delay_progress, ImVec2(0.f, 0.f), fmt::format("{} / 255", panel_regs->dt).c_str());
       ImGui::SameLine();
       ImGui::Text("Delay (DT)");
       if (ImGui::Button("Set 0")) {
-        regs->dt = 0;
+        emulator->send({emulator_command_type::set_delay_timer, 0, 0});
       }
       ImGui::SameLine();
       if (ImGui::Button("Set 127")) {
-        regs->dt = 127;
+        emulator->send({emulator_command_type::set_delay_timer, 0, 127});
       }
       ImGui::SameLine();
       if (ImGui::Button("Set 255")) {
-        regs->dt = 255;
+        emulator->send({emulator_command_type::set_delay_timer, 0, 255});
       }
       ImGui::PopID();
 
       ImGui::NewLine();
 
       ImGui::PushID("st");
-      float sound_progress = static_cast<float>(regs->st) / 255.0;
-      ImGui::ProgressBar(sound_progress, ImVec2(0.f, 0.f), fmt::format("{} / 255", regs->st).c_str());
+      float sound_progress = static_cast<float>(panel_regs->st) / 255.0;
+      ImGui::ProgressBar(sound_progress, ImVec2(0.f, 0.f), fmt::format("{} / 255", panel_regs->st).c_str());
       ImGui::SameLine();
       ImGui::Text("Sound (ST)");
       if (ImGui::Button("Set 0")) {
-        regs->st = 0;
+        emulator->send({emulator_command_type::set_sound_timer, 0, 0});
       }
       ImGui::SameLine();
       if (ImGui::Button("Set 127")) {
-        regs->st = 127;
+        emulator->send({emulator_command_type::set_sound_timer, 0, 127});
       }
       ImGui::SameLine();
       if (ImGui::Button("Set 255")) {
-        regs->st = 255;
+        emulator->send({emulator_command_type::set_sound_timer, 0, 255});
       }
       ImGui::PopID();
     }
     ImGui::End();
+    timers_panel.end_profile();
+  }
+
+  if (settings.show_profiler) {
+    if (ImGui::Begin("Profiler", &settings.show_profiler)) {
+      ImGui::Text("UI frame: %.3f ms", frame_cost * 1000.0);
+
+      if (ImGui::BeginTable("panels", 5, ImGuiTableFlags_Borders)) {
+        ImGui::TableSetupColumn("Panel");
+        ImGui::TableSetupColumn("Refresh");
+        ImGui::TableSetupColumn("Rate");
+        ImGui::TableSetupColumn("Cost");
+        ImGui::TableSetupColumn("Frame");
+        ImGui::TableHeadersRow();
+
+        for (PanelRefresh *panel : {&registers_panel, &memory_panel,
+                                    &instructions_panel, &timers_panel}) {
+          ImGui::TableNextRow();
+          panel->draw_row(frame_cost);
+        }
+        ImGui::EndTable();
+      }
+    }
+    ImGui::End();
   }
 
   rlImGuiEnd();
 
+  frame_cost += (frame_timer.duration() - frame_cost) * kProfileSmoothing;
+
   if (settings.show_fps) {
-    DrawFPS(10, GetScreenHeight() - 24);
+    DrawText(TextFormat("%.0f FPS", redraw_rate), 10, GetScreenHeight() - 24,
+             20, LIME);
+  }
+
+  if (turbo_active) {
+    DrawText(TextFormat("TURBO %.1fx", speed_multiplier), 10,
+             GetScreenHeight() - 48, 20, LIME);
+  }
+
+  if (state.movie == movie_mode::recording) {
+    DrawText("REC", GetScreenWidth() - 50, GetScreenHeight() - 24, 20, RED);
+  } else if (state.movie == movie_mode::replaying) {
+    DrawText("REPLAY", GetScreenWidth() - 84, GetScreenHeight() - 24, 20, LIME);
   }
 
   EndDrawing();
@@ -603,7 +839,7 @@ bool Interface::update() {
   return WindowShouldClose() || should_close;
 }
 
-void Interface::render_main_menu() {
+void Interface::render_main_menu(const emulator_state &state) {
   interface_settings &settings = config.settings;
 
   if (ImGui::BeginMainMenuBar()) {
@@ -615,6 +851,57 @@ void Interface::render_main_menu() {
 
       ImGui::Separator();
 
+      uint32_t save_slots = state.save_slots;
+      if (ImGui::BeginMenu("Save State", rom_loaded)) {
+        for (int slot = 0; slot < kSaveSlotCount; slot += 1) {
+          std::string label = fmt::format("Slot {}", slot);
+          if (ImGui::MenuItem(label.c_str(),
+                              slot == selected_slot ? "F5" : nullptr,
+                              save_slots & (1u << slot))) {
+            selected_slot = slot;
+            save_to_slot(slot);
+          }
+        }
+        ImGui::EndMenu();
+      }
+      if (ImGui::BeginMenu("Load State", rom_loaded)) {
+        for (int slot = 0; slot < kSaveSlotCount; slot += 1) {
+          std::string label = fmt::format("Slot {}", slot);
+          bool available =
+              settings.persist_states || (save_slots & (1u << slot));
+          if (ImGui::MenuItem(label.c_str(),
+                              slot == selected_slot ? "F9" : nullptr, false,
+                              available)) {
+            selected_slot = slot;
+            load_from_slot(slot);
+          }
+        }
+        ImGui::EndMenu();
+      }
+      ImGui::MenuItem("Keep States on Disk", nullptr, &settings.persist_states);
+
+      ImGui::Separator();
+
+      movie_mode movie = state.movie;
+      if (ImGui::MenuItem("Record Movie", nullptr, false,
+                          rom_loaded && movie == movie_mode::none)) {
+        emulator->send({emulator_command_type::start_recording});
+      }
+      if (ImGui::MenuItem("Stop Recording...", nullptr, false,
+                          movie == movie_mode::recording)) {
+        open_save_movie_dialog();
+      }
+      if (ImGui::MenuItem("Play Movie...", nullptr, false,
+                          rom_loaded && movie == movie_mode::none)) {
+        open_play_movie_dialog();
+      }
+      if (ImGui::MenuItem("Stop Movie", nullptr, false,
+                          movie == movie_mode::replaying)) {
+        emulator->send({emulator_command_type::stop_replay});
+      }
+
+      ImGui::Separator();
+
       if (ImGui::MenuItem("Quit", "Ctrl+Q")) {
         should_close = true;
       }
@@ -622,20 +909,27 @@ void Interface::render_main_menu() {
     }
     if (ImGui::BeginMenu("Emulation")) {
       ImGui::MenuItem("Auto Play", nullptr, &settings.auto_play);
+      if (ImGui::MenuItem("Unthrottled", nullptr, &unthrottled)) {
+        emulator->send({emulator_command_type::set_unthrottled, 0,
+                        turbo_active || unthrottled});
+      }
+      ImGui::MenuItem("Turbo", "Tab", &turbo_toggled);
       ImGui::Separator();
-      bool is_playing = interpreter->is_playing();
+      bool is_playing = state.playing;
       if (ImGui::MenuItem("Play", nullptr, false, !is_playing)) {
-        interpreter->play();
+        emulator->send({emulator_command_type::play});
       }
       if (ImGui::MenuItem("Pause", nullptr, false, is_playing)) {
-        interpreter->stop();
+        emulator->send({emulator_command_type::stop});
+      }
+      if (ImGui::MenuItem("Step Back", nullptr, false, !is_playing)) {
+        emulator->send({emulator_command_type::step_back});
       }
       if (ImGui::MenuItem("Step", nullptr, false, !is_playing)) {
-        interpreter->step();
+        emulator->send({emulator_command_type::step});
       }
       if (ImGui::MenuItem("Reset", nullptr, false, !is_playing)) {
-        interpreter->reset();
-        interpreter->load_rom_bytes(rom);
+        emulator->send({emulator_command_type::reset});
       }
       ImGui::EndMenu();
     }
@@ -654,6 +948,7 @@ void Interface::render_main_menu() {
       ImGui::MenuItem("Timers", nullptr, &settings.show_timers);
       ImGui::MenuItem("Audio", nullptr, &settings.show_audio);
       ImGui::MenuItem("Miscellaneous", nullptr, &settings.show_misc);
+      ImGui::MenuItem("Profiler", nullptr, &settings.show_profiler);
       ImGui::Separator();
       if (ImGui::MenuItem("Lock FPS", nullptr, &settings.lock_fps)) {
         if (settings.lock_fps) {
@@ -688,6 +983,7 @@ void Interface::cleanup() {
   settings.window_height = GetScreenHeight();
 
   spdlog::info("Cleaning up interface");
+  screen.cleanup();
   sounds.cleanup();
   rlImGuiShutdown();
   CloseAudioDevice();
@@ -722,6 +1018,41 @@ void Interface::open_load_rom_dialog() {
   }
 }
 
+void Interface::open_save_movie_dialog() {
+  nfdchar_t *movie_path;
+  nfdfilteritem_t filter_item[1] = {{"Movie", "c8m"}};
+  nfdresult_t result =
+      NFD_SaveDialog(&movie_path, filter_item, 1, NULL, "movie.c8m");
+
+  if (result == NFD_OKAY) {
+    emulator_command command{emulator_command_type::stop_recording};
+    command.path = movie_path;
+    emulator->send(std::move(command));
+    NFD_FreePath(movie_path);
+  } else if (result == NFD_CANCEL) {
+    // keeps recording
+    spdlog::debug("User pressed cancel.");
+  } else {
+    spdlog::debug("Error: {}\n", NFD_GetError());
+  }
+}
+
+void Interface::open_play_movie_dialog() {
+  nfdchar_t *movie_path;
+  nfdfilteritem_t filter_item[1] = {{"Movie", "c8m"}};
+  nfdresult_t result = NFD_OpenDialog(&movie_path, filter_item, 1, NULL);
+  if (result == NFD_OKAY) {
+    emulator_command command{emulator_command_type::start_replay};
+    command.path = movie_path;
+    emulator->send(std::move(command));
+    NFD_FreePath(movie_path);
+  } else if (result == NFD_CANCEL) {
+    spdlog::debug("User pressed cancel.");
+  } else {
+    spdlog::debug("Error: {}\n", NFD_GetError());
+  }
+}
+
 void Interface::load_rom(const std::string &filename) {
   spdlog::debug("Loading rom: {}", filename);
 
@@ -737,15 +1068,26 @@ void Interface::load_rom(const std::string &filename) {
   }
 
   in.seekg(0, std::ifstream::beg);
-  rom = {std::istreambuf_iterator<char>(in), {}};
+  std::vector<uint8_t> rom = {std::istreambuf_iterator<char>(in), {}};
 
-  interpreter->stop();
-  interpreter->reset();
-  interpreter->load_rom_bytes(rom);
+  emulator->send({emulator_command_type::load_rom, 0,
+                  config.settings.auto_play, std::move(rom)});
+}
+
+void Interface::save_to_slot(int slot) {
+  if (!rom_loaded) {
+    return;
+  }
+  emulator->send({emulator_command_type::save_state, slot,
+                  config.settings.persist_states});
+}
 
-  if (config.settings.auto_play) {
-    interpreter->play();
+void Interface::load_from_slot(int slot) {
+  if (!rom_loaded) {
+    return;
   }
+  emulator->send({emulator_command_type::load_state, slot,
+                  config.settings.persist_states});
 }
 
 void Interface::set_window_title(const std::string &title) {
@@ -1,11 +1,12 @@
 #pragma once
 
 #include "config.h"
-#include "interpreter.h"
+#include "emulator.h"
 #include "applog.h"
 #include "screen.h"
 #include "assembly.h"
 #include "keyboard.h"
+#include "panel_refresh.h"
 #include "sound.h"
 
 #include <imgui.h>
@@ -31,7 +32,12 @@ struct interface_settings {
   bool show_keyboard;
   bool show_audio;
   bool show_timers;
+  bool show_profiler;
   bool auto_play;
+  bool persist_states;
+  // seed every reset with seed instead of a fresh one
+  bool use_seed;
+  uint32_t seed;
 
   void reset() {
     volume = 50.0f;
@@ -48,13 +54,17 @@ struct interface_settings {
     show_keyboard = false;
     show_audio = false;
     show_timers = false;
+    show_profiler = false;
     auto_play = true;
+    persist_states = false;
+    use_seed = false;
+    seed = 0;
   }
 };
 
 class Interface {
 public:
-  Interface(std::shared_ptr<registers> regs, Interpreter *interpreter);
+  explicit Interface(Emulator *emulator);
 
   void initialize();
   bool update();
@@ -63,13 +73,17 @@ public:
 private:
   void open_load_rom_dialog();
   void load_rom(const std::string &string);
+  void open_save_movie_dialog();
+  void open_play_movie_dialog();
+  void save_to_slot(int slot);
+  void load_from_slot(int slot);
 
-  void render_main_menu();
+  void render_main_menu(const emulator_state &state);
   void reset_windows();
   void set_window_title(const std::string &string);
 
 private:
-  Interpreter *interpreter;
+  Emulator *emulator;
   MemoryEditor mem_editor;
   AppLog app_log;
   Screen screen;
@@ -77,6 +91,13 @@ private:
   Keyboard keyboard;
   Config<interface_settings> config;
   SoundManager sounds;
-  std::vector<uint8_t> rom;
+  // copy of the latest emulator state, refreshed every frame
   std::shared_ptr<registers> regs;
+
+  PanelRefresh registers_panel{"Registers"};
+  PanelRefresh memory_panel{"Memory"};
+  PanelRefresh instructions_panel{"Instructions"};
+  PanelRefresh timers_panel{"Timers"};
+  Timer frame_timer;
+  double frame_cost = 0;
 };
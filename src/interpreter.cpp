@@ -1,12 +1,127 @@
 #include "interpreter.h"
-#include "random.h"
+#include "fork.h"
 
-#include <_types/_uint16_t.h>
-#include <_types/_uint8_t.h>
+#include <cstddef>
+#include <cstring>
+#include <iterator>
 #include <optional>
 #include <spdlog/spdlog.h>
 #include <utility>
 
+#if defined(__GNUC__) || defined(__clang__)
+#define ACE_COMPUTED_GOTO 1
+#define ACE_COLD __attribute__((cold, noinline))
+#else
+#define ACE_COLD
+#endif
+
+namespace {
+
+constexpr size_t kOpcodeCount = static_cast<size_t>(opcode::invalid) + 1;
+
+constexpr opcode decode_opcode(uint16_t instr) {
+  switch (instr >> 12) {
+  case 0x0:
+    if (instr == 0x00e0) {
+      return opcode::cls;
+    } else if (instr == 0x00ee) {
+      return opcode::ret;
+    }
+    // 0NNN machine routines are unimplemented
+    break;
+  case 0x1:
+    return opcode::jp;
+  case 0x2:
+    return opcode::call;
+  case 0x3:
+    return opcode::se_vx_nn;
+  case 0x4:
+    return opcode::sne_vx_nn;
+  case 0x5:
+    return opcode::se_vx_vy;
+  case 0x6:
+    return opcode::ld_vx_nn;
+  case 0x7:
+    return opcode::add_vx_nn;
+  case 0x8:
+    switch (instr & 0xf) {
+    case 0x0:
+      return opcode::ld_vx_vy;
+    case 0x1:
+      return opcode::or_vx_vy;
+    case 0x2:
+      return opcode::and_vx_vy;
+    case 0x3:
+      return opcode::xor_vx_vy;
+    case 0x4:
+      return opcode::add_vx_vy;
+    case 0x5:
+      return opcode::sub_vx_vy;
+    case 0x6:
+      return opcode::shr_vx_vy;
+    case 0x7:
+      return opcode::subn_vx_vy;
+    case 0xe:
+      return opcode::shl_vx_vy;
+    }
+    break;
+  case 0x9:
+    return opcode::sne_vx_vy;
+  case 0xa:
+    return opcode::ld_i;
+  case 0xb:
+    return opcode::jp_v0;
+  case 0xc:
+    return opcode::rnd;
+  case 0xd:
+    return opcode::drw;
+  case 0xe:
+    switch (instr & 0xff) {
+    case 0x9e:
+      return opcode::skp;
+    case 0xa1:
+      return opcode::sknp;
+    }
+    break;
+  case 0xf:
+    switch (instr & 0xff) {
+    case 0x07:
+      return opcode::ld_vx_dt;
+    case 0x0a:
+      return opcode::ld_vx_k;
+    case 0x15:
+      return opcode::ld_dt_vx;
+    case 0x18:
+      return opcode::ld_st_vx;
+    case 0x1e:
+      return opcode::add_i_vx;
+    case 0x29:
+      return opcode::ld_f_vx;
+    case 0x33:
+      return opcode::ld_b_vx;
+    case 0x55:
+      return opcode::ld_i_vx;
+    case 0x65:
+      return opcode::ld_vx_i;
+    }
+    break;
+  }
+
+  return opcode::invalid;
+}
+
+constexpr std::array<opcode, 0x10000> make_opcode_table() {
+  std::array<opcode, 0x10000> table{};
+  for (size_t instr = 0; instr < table.size(); instr += 1) {
+    table[instr] = decode_opcode(static_cast<uint16_t>(instr));
+  }
+  return table;
+}
+
+constexpr std::array<opcode, 0x10000> kOpcodeTable = make_opcode_table();
+
+} // namespace
+
 Interpreter::Interpreter(std::shared_ptr<registers> regs)
     : regs(std::move(regs)) {}
 
@@ -14,47 +129,75 @@ void Interpreter::initialize() {
   timer.reset();
   reset();
 
-  spdlog::info("Initialized interpreter");
+  spdlog::debug("Initialized interpreter");
 }
 
 void Interpreter::update() {
-  update_keyboard();
-
-  double update_frequency = 1.0 / static_cast<double>(update_play_rate);
-
   double dt = timer.duration();
   timer.reset();
 
-  update_timers(dt);
-
-  if (playing) {
-    last_update += dt;
+  if (!playing) {
+    pending_time = 0;
+    return;
+  }
 
-    while (last_update > update_frequency) {
-      step();
-      last_update -= update_frequency;
+  if (unthrottled) {
+    while (playing && timer.duration() < kUnthrottledTimeSlice) {
+      if (elide_timer_wait(kMaxElidedFrames) == 0) {
+        run_frame();
+      }
     }
-  } else {
-    last_update = 0;
+    timer.reset();
+    return;
+  }
+
+  pending_time += dt * speed;
+
+  int frames = static_cast<int>(pending_time / kTimerFrequency);
+  pending_time -= frames * kTimerFrequency;
+
+  if (frames > max_catch_up_frames) {
+    stats.dropped_frames += frames - max_catch_up_frames;
+    frames = max_catch_up_frames;
+  }
+
+  while (playing && frames > 0) {
+    run_frame();
+    frames -= 1;
   }
 }
 
-void Interpreter::cleanup() { spdlog::info("Cleaning up interpreter"); }
+void Interpreter::cleanup() { spdlog::debug("Cleaning up interpreter"); }
 
 void Interpreter::load_rom_bytes(const std::vector<uint8_t> &bytes) {
   std::copy(bytes.begin(), bytes.end(), regs->mem.begin() + kRomStartIndex);
+  invalidate_memory(kRomStartIndex, bytes.size());
 }
 
 void Interpreter::reset() {
   regs->reset();
+  invalidate_all();
 
   regs->pc = 0x200;
   init_font_sprites();
+
+  seed = fixed_seed ? *fixed_seed : make_random_seed();
+  rng.seed(seed);
+
+  stats = {};
+  pending_time = 0;
+  frame_remainder = 0;
+  cycles = 0;
+  begin_frame();
 }
 
 void Interpreter::play() {
   spdlog::debug("Playing.");
   playing = true;
+  // time spent paused isn't owed to the guest
+  timer.reset();
+  pending_time = 0;
+  reset_idle_probe();
 }
 
 void Interpreter::stop() {
@@ -64,255 +207,970 @@ void Interpreter::stop() {
 
 bool Interpreter::is_playing() const { return playing; }
 
-void Interpreter::step() {
-  uint8_t instr_hi = regs->mem[regs->pc];
-  uint8_t instr_lo = regs->mem[regs->pc + 1];
+void Interpreter::set_backend(backend_type type) {
+  if (type == backend_type::recompiler) {
+    if (!Recompiler::is_supported()) {
+      spdlog::warn("Recompiler is not supported on this platform");
+      return;
+    }
+    if (!recompiler) {
+      spdlog::debug("Using recompiler backend");
+      recompiler = std::make_unique<Recompiler>();
+    }
+    if (!recompiler->is_usable()) {
+      spdlog::warn("Recompiler is unavailable, using the interpreter");
+      recompiler.reset();
+    }
+  } else if (recompiler) {
+    spdlog::debug("Using interpreter backend");
+    recompiler.reset();
+  }
+}
 
-  regs->pc += 2;
+backend_type Interpreter::get_backend() const {
+  return recompiler ? backend_type::recompiler : backend_type::interpreter;
+}
 
-  uint16_t instr = instr_lo | (instr_hi << 8);
-  uint8_t first = instr_hi >> 4;
-  uint8_t x = instr_hi & 0xf;
-  uint8_t y = instr_lo >> 4;
-  uint8_t n = instr & 0xf;
-  uint8_t nn = instr_lo;
-  uint16_t nnn = (instr_lo | (instr_hi << 8)) & 0xfff;
+void Interpreter::set_breakpoint(uint16_t addr, bool enabled) {
+  addr &= kMemSize - 1;
+  breakpoints[addr] = enabled;
+  decoded[addr].op = opcode::undecoded;
+}
 
-  switch (first) {
-  case 0x0:
-    if (instr == 0x00e0) {
-      // clear screen
-      screen_clear();
-    } else if (instr == 0x00ee) {
-      // returns from subroutine
-      regs->pc = stack_pop();
-    } else {
-      // call machine routine at NNN
-      // unimplemented
-      spdlog::warn("Unimplemented instruction 1NNN: {:x}", nnn);
+bool Interpreter::has_breakpoint(uint16_t addr) const {
+  return breakpoints[addr & (kMemSize - 1)];
+}
+
+const scheduler_stats &Interpreter::get_stats() const { return stats; }
+
+uint64_t Interpreter::get_cycle() const {
+  return cycles + frame_quota - frame_remaining;
+}
+
+void Interpreter::set_frame_callback(std::function<void()> callback) {
+  frame_callback = std::move(callback);
+}
+
+void Interpreter::set_seed(std::optional<uint32_t> seed_) {
+  fixed_seed = seed_;
+}
+
+uint32_t Interpreter::get_seed() const { return seed; }
+
+void Interpreter::set_input_callback(
+    std::function<void(uint64_t cycle)> callback) {
+  input_callback = std::move(callback);
+}
+
+void Interpreter::save_state(interpreter_state &state) const {
+  state.key_down = key_down;
+  state.key_released = key_released;
+  state.frame_remaining = frame_remaining;
+  state.frame_remainder = frame_remainder;
+  state.frame_quota = frame_quota;
+  state.cycles = cycles;
+  state.rng = rng.get_state();
+  state.seed = seed;
+  state.playing = playing;
+}
+
+void Interpreter::load_state(const interpreter_state &state) {
+  apply_state(state);
+  // memory was replaced wholesale, nothing decoded or compiled still holds
+  invalidate_all();
+}
+
+void Interpreter::fork(MachineFork &child) {
+  if (!fork_pages || stale_pages.any()) {
+    // pages already handed out are never written, refresh a private table
+    if (!fork_pages) {
+      fork_pages = std::make_shared<memory_page_table>();
+      stale_pages.set();
+    } else if (fork_pages.use_count() > 1) {
+      fork_pages = std::make_shared<memory_page_table>(*fork_pages);
     }
-    break;
-  case 0x1:
-    // jumps to address NNN
-    regs->pc = nnn;
-    break;
-  case 0x2:
-    // calls subroutine at NNN
-    stack_push(regs->pc);
-    regs->pc = nnn;
-    break;
-  case 0x3:
-    // skips next instruction if VX == NN
-    if (regs->v[x] == nn) {
-      regs->pc += 2;
+    for (int index = 0; index < kMemPageCount; index += 1) {
+      if (stale_pages[index]) {
+        auto page = std::make_shared<memory_page>();
+        std::copy_n(regs->mem.begin() + index * kMemPageSize, kMemPageSize,
+                    page->begin());
+        (*fork_pages)[index] = std::move(page);
+      }
     }
-    break;
-  case 0x4:
-    // skips next instruction if VX != NN
-    if (regs->v[x] != nn) {
-      regs->pc += 2;
+    stale_pages.reset();
+  }
+  child.pages = fork_pages;
+
+  child.pc = regs->pc;
+  child.i = regs->i;
+  child.dt = regs->dt;
+  child.st = regs->st;
+  child.v = regs->v;
+  child.kbd = regs->kbd;
+  child.screen = regs->screen;
+  save_state(child.interpreter);
+}
+
+void Interpreter::resume(const MachineFork &fork) {
+  if (fork_pages != fork.pages || stale_pages.any()) {
+    for (int index = 0; index < kMemPageCount; index += 1) {
+      const auto &page = (*fork.pages)[index];
+      if (fork_pages && !stale_pages[index] &&
+          (*fork_pages)[index] == page) {
+        continue;
+      }
+      const uint16_t start = index * kMemPageSize;
+      std::copy(page->begin(), page->end(), regs->mem.begin() + start);
+      invalidate_memory(start, kMemPageSize);
     }
-    break;
-  case 0x5:
-    // skips next instruction if VX == VY
-    if (regs->v[x] == regs->v[y]) {
-      regs->pc += 2;
+    fork_pages = fork.pages;
+    stale_pages.reset();
+  }
+
+  regs->pc = fork.pc;
+  regs->i = fork.i;
+  regs->dt = fork.dt;
+  regs->st = fork.st;
+  regs->v = fork.v;
+  regs->kbd = fork.kbd;
+  regs->screen = fork.screen;
+  regs->screen_generation += 1;
+  apply_state(fork.interpreter);
+}
+
+void Interpreter::apply_state(const interpreter_state &state) {
+  key_down = state.key_down;
+  key_released = state.key_released;
+  frame_remaining = state.frame_remaining;
+  frame_remainder = state.frame_remainder;
+  frame_quota = state.frame_quota;
+  cycles = state.cycles;
+  rng.set_state(state.rng);
+  seed = state.seed;
+  playing = state.playing;
+
+  side_effects += 1;
+  reset_idle_probe();
+  timer.reset();
+  pending_time = 0;
+}
+
+void Interpreter::step() {
+  reset_idle_probe();
+  interpret(1);
+
+  // a single step is still one instruction's worth of guest time
+  frame_remaining -= 1;
+  if (frame_remaining <= 0) {
+    end_frame();
+  }
+}
+
+bool Interpreter::run_frame() {
+  while (frame_remaining > 0) {
+    run_result result = run(frame_remaining);
+    frame_remaining -= result.executed;
+
+    if (result.reason == stop_reason::idle) {
+      // whole loop iterations leave the state untouched, only run the rest
+      int skipped = frame_remaining - frame_remaining % idle_period;
+      frame_remaining -= skipped;
+      stats.instructions += skipped;
+      stats.idle_instructions += skipped;
+    } else if (result.reason == stop_reason::waiting_for_key) {
+      // FX0A spins until a key is released, which only happens between frames
+      stats.instructions += frame_remaining;
+      stats.idle_instructions += frame_remaining;
+      frame_remaining = 0;
+    } else if (result.reason == stop_reason::breakpoint) {
+      spdlog::info("Breakpoint hit at {:03x}", regs->pc);
+      stop();
+      return false;
     }
-    break;
-  case 0x6:
-    // sets VX to NN
-    regs->v[x] = nn;
-    break;
-  case 0x7:
-    // adds NN to VX (carry flag not changed)
-    regs->v[x] += nn;
-    break;
-  case 0x8:
-    switch (n) {
-    case 0x0:
-      // sets VX to VY
-      regs->v[x] = regs->v[y];
-      break;
-    case 0x1:
-      // sets VX to VX | VY
-      regs->v[0xf] = 0;
-      regs->v[x] = regs->v[x] | regs->v[y];
-      break;
-    case 0x2:
-      // sets VX to VX & VY
-      regs->v[0xf] = 0;
-      regs->v[x] = regs->v[x] & regs->v[y];
-      break;
-    case 0x3:
-      // sets VX to VX xor VY
-      regs->v[0xf] = 0;
-      regs->v[x] = regs->v[x] xor regs->v[y];
-      break;
-    case 0x4:
-      // adds VY to VX, set VF to 1 if overflow else 0
-      {
-        uint16_t val = regs->v[x] + regs->v[y];
-        regs->v[x] = val & 0xff;
-        regs->v[0xf] = val >> 8;
-      }
-      break;
-    case 0x5:
-      // subtract VY from VX, set VF to 0 if underflow else 1
-      {
-        uint8_t result = regs->v[x] >= regs->v[y] ? 1 : 0;
-        regs->v[x] -= regs->v[y];
-        regs->v[0xf] = result;
-      }
-      break;
-    case 0x6:
-      // store LSB of VX in VF, right shift VX by 1
-      {
-        regs->v[x] = regs->v[y];
-        uint8_t lsb = regs->v[x] & 0x1;
-        regs->v[x] >>= 1;
-        regs->v[0xf] = lsb;
-      }
-      break;
-    case 0x7:
-      // sets VX to VY - VX, set VF to 0 if underflow else 1
-      regs->v[x] = regs->v[y] - regs->v[x];
-      regs->v[0xf] = regs->v[y] >= regs->v[x] ? 1 : 0;
-      break;
-    case 0xe:
-      // store MSB of VX in VF, left shift VX by 1
-      {
-        regs->v[x] = regs->v[y];
-        uint8_t msb = (regs->v[x] & 0x8) >> 3;
-        regs->v[x] <<= 1;
-        regs->v[0xf] = msb;
-      }
+  }
+
+  end_frame();
+  return true;
+}
+
+int Interpreter::run_frames(int count) {
+  int frames = 0;
+  while (frames < count) {
+    int elided = elide_timer_wait(count - frames);
+    if (elided > 0) {
+      frames += elided;
+      continue;
+    }
+
+    if (!run_frame()) {
       break;
-    default:
-      spdlog::warn("Invalid instruction: {:x}", instr);
     }
-    break;
-  case 0x9:
-    // skips next instruction if VX != VY
-    if (regs->v[x] != regs->v[y]) {
-      regs->pc += 2;
+    frames += 1;
+  }
+  return frames;
+}
+
+// Jumps over whole frames spent in the canonical delay loop
+//
+//   head:     FX07
+//             3XNN / 4XNN
+//             1NNN (head)
+//
+// when called at a frame boundary inside it. The loop reads nothing but DT,
+// which is constant within a frame, so whether a frame keeps polling and
+// where in the loop it ends up are known without running it.
+int Interpreter::elide_timer_wait(int max_frames) {
+  if (frame_remaining != frame_quota || update_play_rate < 3 * kTimerRate ||
+      breakpoints.any()) {
+    return 0;
+  }
+
+  auto word_at = [this](int addr) -> uint16_t {
+    return (regs->mem[addr & (kMemSize - 1)] << 8) |
+           regs->mem[(addr + 1) & (kMemSize - 1)];
+  };
+
+  int head = -1;
+  int pos = 0;
+  for (; pos < 3; pos += 1) {
+    int addr = regs->pc - pos * 2;
+    if (addr < 0 || addr + 6 > kMemSize) {
+      continue;
     }
-    break;
-  case 0xa:
-    // sets I to NNN
-    regs->i = nnn;
-    break;
-  case 0xb:
-    // jumps to address NNN + V0
-    regs->pc = nnn + regs->v[0];
-    // TODO: CHIP-48 & SUPER-CHIP - BXNN jump to XNN + VX
-    break;
-  case 0xc:
-    // sets VX to rand() & NN
-    regs->v[x] = random_byte() & nn;
-    break;
-  case 0xd:
-    // draws sprite at coord (VX, VY)
-    screen_draw_sprite(regs->v[x], regs->v[y], n);
-    break;
-  case 0xe:
-    switch (nn) {
-    case 0x9e:
-      // skips next instruction if key stored in VX is pressed
-      if (is_key_pressed(regs->v[x])) {
-        regs->pc += 2;
-      }
+    uint16_t poll = word_at(addr);
+    uint16_t test = word_at(addr + 2);
+    if ((poll & 0xf0ff) == 0xf007 &&
+        ((test >> 12) == 0x3 || (test >> 12) == 0x4) &&
+        ((test >> 8) & 0xf) == ((poll >> 8) & 0xf) &&
+        word_at(addr + 4) == (0x1000 | addr)) {
+      head = addr;
       break;
-    case 0xa1:
-      // skips next instruction if key stored in VX is not pressed
-      if (!is_key_pressed(regs->v[x])) {
-        regs->pc += 2;
-      }
-      break;
-    default:
-      spdlog::warn("Invalid instruction: {:x}", instr);
     }
-    break;
-  case 0xf: {
-    switch (nn) {
-    case 0x07:
-      // sets VX to delay timer
-      regs->v[x] = regs->dt;
-      break;
-    case 0x0a:
-      // wait for keypress, store in VX
-      {
-        auto key = get_pressed_key();
-        if (!key.has_value()) {
-          regs->pc -= 2;
-        } else {
-          spdlog::debug("Key pressed: {}", key.value());
-          regs->v[x] = key.value();
-        }
-      }
-      break;
-    case 0x15:
-      // set delay timer to VX
-      regs->dt = regs->v[x];
-      break;
-    case 0x18:
-      // set sound timer to VX
-      regs->st = regs->v[x];
-      break;
-    case 0x1e:
-      // adds VX to I, VF unchanged
-      regs->i += regs->v[x];
-      break;
-    case 0x29:
-      // sets I to for sprite character in VX
-      regs->i = get_font_sprite_addr(regs->v[x]);
-      break;
-    case 0x33:
-      // stores BCD repr of VX at address I
-      {
-        int i = regs->i;
-        uint8_t val = regs->v[x];
-        regs->mem[i] = val / 100;
-        regs->mem[i + 1] = (val / 10) % 10;
-        regs->mem[i + 2] = val % 10;
-      }
-      break;
-    case 0x55:
-      // stores V0 to VX (inclusive) in memory starting at address I
-      for (int xn = 0, i = regs->i; xn <= x; i++, xn++) {
-        regs->mem[i] = regs->v[xn];
-        // classic chip-8 quirk:
-        regs->i += 1;
-      }
-      break;
-    case 0x65:
-      // fills V0 to VX (inclusive) with values from memory starting at I
-      for (int xn = 0, i = regs->i; xn <= x; xn++, i++) {
-        regs->v[xn] = regs->mem[i];
-        // classic chip-8 quirk:
-        regs->i += 1;
+  }
+  if (head < 0) {
+    return 0;
+  }
+
+  uint16_t test = word_at(head + 2);
+  uint8_t x = (test >> 8) & 0xf;
+  uint8_t nn = test & 0xff;
+  bool skip_if_equal = (test >> 12) == 0x3;
+  auto keeps_polling = [=](uint8_t val) {
+    return skip_if_equal ? val != nn : val == nn;
+  };
+
+  // the first test of this frame may still see VX from the frame before
+  if (pos == 1 && !keeps_polling(regs->v[x])) {
+    return 0;
+  }
+
+  int frames = 0;
+  uint64_t instructions = 0;
+  while (frames < max_frames && keeps_polling(regs->dt)) {
+    // every frame runs at least one full iteration, so the last FX07 of the
+    // frame leaves this frame's DT in VX
+    regs->v[x] = regs->dt;
+    instructions += frame_remaining;
+    pos = (pos + frame_remaining) % 3;
+    // the frame callback may look at the machine between frames
+    regs->pc = head + pos * 2;
+    end_frame();
+    frames += 1;
+  }
+
+  if (frames > 0) {
+    stats.instructions += instructions;
+    stats.idle_instructions += instructions;
+    stats.elided_frames += frames;
+  }
+  return frames;
+}
+
+run_result Interpreter::run(int budget) {
+  if (!recompiler || breakpoints.any()) {
+    return interpret(budget);
+  }
+
+  int executed = 0;
+  while (executed < budget) {
+    uint16_t pc = regs->pc;
+    int count = recompiler->execute(regs.get(), budget - executed);
+    if (count > 0) {
+      executed += count;
+      stats.instructions += count;
+      if (regs->pc <= pc && --idle_probe_countdown == 0 &&
+          probe_idle(stats.instructions)) {
+        return {stop_reason::idle, executed};
       }
-      break;
-    default:
-      spdlog::warn("Invalid instruction: {:x}", instr);
+      continue;
+    }
+    if (!recompiler->is_usable()) {
+      spdlog::warn("Recompiler stopped working, using the interpreter");
+      recompiler.reset();
+      run_result result = interpret(budget - executed);
+      return {result.reason, executed + result.executed};
+    }
+
+    run_result result = interpret(1);
+    executed += result.executed;
+    if (result.reason != stop_reason::budget_exhausted) {
+      return {result.reason, executed};
     }
-  } break;
-  default:
-    spdlog::warn("Invalid instruction: {:x}", instr);
   }
+
+  return {stop_reason::budget_exhausted, executed};
+}
+
+run_result Interpreter::interpret(int budget) {
+  run_result result = dispatch(budget);
+  stats.instructions += result.executed;
+  return result;
+}
+
+bool Interpreter::probe_idle(uint64_t now) {
+  static_assert(offsetof(registers, pc) == 0 &&
+                    offsetof(registers, v) + kGeneralRegisterCount <=
+                        sizeof(idle_probe::regs),
+                "idle probe expects pc..v at the start of registers");
+
+  // the bytes past v belong to the stack pointer, covered by side_effects
+  std::array<uint64_t, 3> state;
+  std::memcpy(state.data(), regs.get(), sizeof(state));
+  uint64_t effects =
+      (static_cast<uint64_t>(side_effects) << 32) | regs->screen_generation;
+
+  if (probe.regs == state && probe.effects == effects) {
+    idle_period = static_cast<int>(now - probe.at);
+    idle_probe_countdown = idle_probe_interval;
+    return true;
+  }
+
+  // loops that do real work only pay for a probe every so often, comparing
+  // any two arrivals is exact so a sparse probe just finds idling later
+  idle_probe_interval = std::min(idle_probe_interval * 2, kMaxIdleProbeInterval);
+  idle_probe_countdown = idle_probe_interval;
+
+  probe.regs = state;
+  probe.effects = effects;
+  probe.at = now;
+  return false;
 }
 
-void Interpreter::update_timers(double dt) {
-  last_tick += dt;
+void Interpreter::reset_idle_probe() {
+  probe = {};
+  idle_probe_interval = 1;
+  idle_probe_countdown = 1;
+}
+
+run_result Interpreter::dispatch(int budget) {
+  int executed = 0;
+  decoded_instruction *instr = nullptr;
+  decoded_instruction resumed;
+
+  if (budget <= 0) {
+    return {stop_reason::budget_exhausted, 0};
+  }
+
+#ifdef ACE_COMPUTED_GOTO
+  static const void *const dispatch_table[] = {
+      &&do_undecoded,
+      &&do_cls,
+      &&do_ret,
+      &&do_jp,
+      &&do_call,
+      &&do_se_vx_nn,
+      &&do_sne_vx_nn,
+      &&do_se_vx_vy,
+      &&do_ld_vx_nn,
+      &&do_add_vx_nn,
+      &&do_ld_vx_vy,
+      &&do_or_vx_vy,
+      &&do_and_vx_vy,
+      &&do_xor_vx_vy,
+      &&do_add_vx_vy,
+      &&do_sub_vx_vy,
+      &&do_shr_vx_vy,
+      &&do_subn_vx_vy,
+      &&do_shl_vx_vy,
+      &&do_sne_vx_vy,
+      &&do_ld_i,
+      &&do_jp_v0,
+      &&do_rnd,
+      &&do_drw,
+      &&do_skp,
+      &&do_sknp,
+      &&do_ld_vx_dt,
+      &&do_ld_vx_k,
+      &&do_ld_dt_vx,
+      &&do_ld_st_vx,
+      &&do_add_i_vx,
+      &&do_ld_f_vx,
+      &&do_ld_b_vx,
+      &&do_ld_i_vx,
+      &&do_ld_vx_i,
+      &&do_breakpoint,
+      &&do_invalid,
+  };
+  static_assert(std::size(dispatch_table) == kOpcodeCount,
+                "dispatch table out of sync with opcode");
+#define DISPATCH() goto *dispatch_table[static_cast<int>(instr->op)]
+#else
+#define DISPATCH() goto dispatch
+#endif
+
+#define NEXT()                                                                 \
+  do {                                                                         \
+    if (++executed >= budget) {                                                \
+      return {stop_reason::budget_exhausted, executed};                        \
+    }                                                                          \
+    goto fetch;                                                                \
+  } while (0)
+
+#define STOP(reason)                                                           \
+  do {                                                                         \
+    return {reason, ++executed};                                               \
+  } while (0)
+
+fetch:
+  instr = &decoded[regs->pc & (kMemSize - 1)];
+  regs->pc += 2;
+  DISPATCH();
+
+#ifndef ACE_COMPUTED_GOTO
+dispatch:
+  switch (instr->op) {
+  case opcode::undecoded:
+    goto do_undecoded;
+  case opcode::cls:
+    goto do_cls;
+  case opcode::ret:
+    goto do_ret;
+  case opcode::jp:
+    goto do_jp;
+  case opcode::call:
+    goto do_call;
+  case opcode::se_vx_nn:
+    goto do_se_vx_nn;
+  case opcode::sne_vx_nn:
+    goto do_sne_vx_nn;
+  case opcode::se_vx_vy:
+    goto do_se_vx_vy;
+  case opcode::ld_vx_nn:
+    goto do_ld_vx_nn;
+  case opcode::add_vx_nn:
+    goto do_add_vx_nn;
+  case opcode::ld_vx_vy:
+    goto do_ld_vx_vy;
+  case opcode::or_vx_vy:
+    goto do_or_vx_vy;
+  case opcode::and_vx_vy:
+    goto do_and_vx_vy;
+  case opcode::xor_vx_vy:
+    goto do_xor_vx_vy;
+  case opcode::add_vx_vy:
+    goto do_add_vx_vy;
+  case opcode::sub_vx_vy:
+    goto do_sub_vx_vy;
+  case opcode::shr_vx_vy:
+    goto do_shr_vx_vy;
+  case opcode::subn_vx_vy:
+    goto do_subn_vx_vy;
+  case opcode::shl_vx_vy:
+    goto do_shl_vx_vy;
+  case opcode::sne_vx_vy:
+    goto do_sne_vx_vy;
+  case opcode::ld_i:
+    goto do_ld_i;
+  case opcode::jp_v0:
+    goto do_jp_v0;
+  case opcode::rnd:
+    goto do_rnd;
+  case opcode::drw:
+    goto do_drw;
+  case opcode::skp:
+    goto do_skp;
+  case opcode::sknp:
+    goto do_sknp;
+  case opcode::ld_vx_dt:
+    goto do_ld_vx_dt;
+  case opcode::ld_vx_k:
+    goto do_ld_vx_k;
+  case opcode::ld_dt_vx:
+    goto do_ld_dt_vx;
+  case opcode::ld_st_vx:
+    goto do_ld_st_vx;
+  case opcode::add_i_vx:
+    goto do_add_i_vx;
+  case opcode::ld_f_vx:
+    goto do_ld_f_vx;
+  case opcode::ld_b_vx:
+    goto do_ld_b_vx;
+  case opcode::ld_i_vx:
+    goto do_ld_i_vx;
+  case opcode::ld_vx_i:
+    goto do_ld_vx_i;
+  case opcode::breakpoint:
+    goto do_breakpoint;
+  case opcode::invalid:
+    goto do_invalid;
+  }
+#endif
+
+do_undecoded:
+  *instr = decode(regs->pc - 2);
+  DISPATCH();
 
-  while (last_tick > kTimerFrequency) {
-    if (regs->dt > 0) {
-      regs->dt -= 1;
+do_cls:
+  op_cls(*instr);
+  STOP(stop_reason::screen_drawn);
+do_ret:
+  op_ret(*instr);
+  NEXT();
+do_jp:
+  if (instr->nnn < regs->pc) {
+    op_jp(*instr);
+    if (--idle_probe_countdown == 0 &&
+        probe_idle(stats.instructions + executed + 1)) {
+      STOP(stop_reason::idle);
     }
-    if (regs->st > 0) {
-      regs->st -= 1;
+    NEXT();
+  }
+  op_jp(*instr);
+  NEXT();
+do_call:
+  op_call(*instr);
+  NEXT();
+do_se_vx_nn:
+  op_se_vx_nn(*instr);
+  NEXT();
+do_sne_vx_nn:
+  op_sne_vx_nn(*instr);
+  NEXT();
+do_se_vx_vy:
+  op_se_vx_vy(*instr);
+  NEXT();
+do_ld_vx_nn:
+  op_ld_vx_nn(*instr);
+  NEXT();
+do_add_vx_nn:
+  op_add_vx_nn(*instr);
+  NEXT();
+do_ld_vx_vy:
+  op_ld_vx_vy(*instr);
+  NEXT();
+do_or_vx_vy:
+  op_or_vx_vy(*instr);
+  NEXT();
+do_and_vx_vy:
+  op_and_vx_vy(*instr);
+  NEXT();
+do_xor_vx_vy:
+  op_xor_vx_vy(*instr);
+  NEXT();
+do_add_vx_vy:
+  op_add_vx_vy(*instr);
+  NEXT();
+do_sub_vx_vy:
+  op_sub_vx_vy(*instr);
+  NEXT();
+do_shr_vx_vy:
+  op_shr_vx_vy(*instr);
+  NEXT();
+do_subn_vx_vy:
+  op_subn_vx_vy(*instr);
+  NEXT();
+do_shl_vx_vy:
+  op_shl_vx_vy(*instr);
+  NEXT();
+do_sne_vx_vy:
+  op_sne_vx_vy(*instr);
+  NEXT();
+do_ld_i:
+  op_ld_i(*instr);
+  NEXT();
+do_jp_v0:
+  op_jp_v0(*instr);
+  NEXT();
+do_rnd:
+  op_rnd(*instr);
+  NEXT();
+do_drw:
+  op_drw(*instr);
+  STOP(stop_reason::screen_drawn);
+do_skp:
+  op_skp(*instr);
+  NEXT();
+do_sknp:
+  op_sknp(*instr);
+  NEXT();
+do_ld_vx_dt:
+  op_ld_vx_dt(*instr);
+  NEXT();
+do_ld_vx_k:
+  if (!op_ld_vx_k(*instr)) {
+    STOP(stop_reason::waiting_for_key);
+  }
+  NEXT();
+do_ld_dt_vx:
+  op_ld_dt_vx(*instr);
+  NEXT();
+do_ld_st_vx:
+  op_ld_st_vx(*instr);
+  NEXT();
+do_add_i_vx:
+  op_add_i_vx(*instr);
+  NEXT();
+do_ld_f_vx:
+  op_ld_f_vx(*instr);
+  NEXT();
+do_ld_b_vx:
+  op_ld_b_vx(*instr);
+  NEXT();
+do_ld_i_vx:
+  op_ld_i_vx(*instr);
+  NEXT();
+do_ld_vx_i:
+  op_ld_vx_i(*instr);
+  NEXT();
+do_breakpoint:
+  if (executed > 0) {
+    // stop in front of the breakpoint, it runs when execution resumes
+    regs->pc -= 2;
+    return {stop_reason::breakpoint, executed};
+  }
+  resumed = *instr;
+  resumed.op = kOpcodeTable[resumed.instr];
+  instr = &resumed;
+  DISPATCH();
+
+do_invalid:
+  op_invalid(*instr);
+  STOP(stop_reason::invalid_instruction);
+
+#undef STOP
+#undef NEXT
+#undef DISPATCH
+}
+
+void Interpreter::invalidate_memory(uint16_t addr, size_t len) {
+  // an instruction at addr - 1 overlaps the first written byte
+  size_t start = addr > 0 ? addr - 1 : 0;
+  size_t end = std::min<size_t>(addr + len, kMemSize);
+  for (size_t idx = start; idx < end; idx += 1) {
+    decoded[idx].op = opcode::undecoded;
+  }
+
+  if (recompiler) {
+    recompiler->invalidate(addr, len);
+  }
+
+  if (addr < kMemSize && len > 0) {
+    size_t last = std::min<size_t>(addr + len, kMemSize) - 1;
+    for (size_t page = addr / kMemPageSize; page <= last / kMemPageSize;
+         page += 1) {
+      stale_pages.set(page);
     }
+  }
+
+  side_effects += 1;
+}
+
+void Interpreter::invalidate_all() {
+  for (auto &instr : decoded) {
+    instr.op = opcode::undecoded;
+  }
+  stale_pages.set();
+
+  if (recompiler) {
+    recompiler->flush();
+  }
+}
+
+void Interpreter::write_memory(uint16_t addr, uint8_t val) {
+  // I can run past the end of memory, wrap like the address bus would
+  addr &= kMemSize - 1;
+  regs->mem[addr] = val;
+  invalidate_memory(addr);
+}
+
+decoded_instruction Interpreter::decode(uint16_t addr) const {
+  uint8_t instr_hi = regs->mem[addr & (kMemSize - 1)];
+  uint8_t instr_lo = regs->mem[(addr + 1) & (kMemSize - 1)];
+
+  decoded_instruction result;
+  result.instr = instr_lo | (instr_hi << 8);
+  result.op = breakpoints[addr & (kMemSize - 1)] ? opcode::breakpoint
+                                                : kOpcodeTable[result.instr];
+  result.x = instr_hi & 0xf;
+  result.y = instr_lo >> 4;
+  result.n = instr_lo & 0xf;
+  result.nn = instr_lo;
+  result.nnn = result.instr & 0xfff;
+  return result;
+}
 
-    last_tick -= kTimerFrequency;
+void Interpreter::op_cls(const decoded_instruction &) {
+  // clear screen
+  screen_clear();
+}
+
+void Interpreter::op_ret(const decoded_instruction &) {
+  // returns from subroutine
+  regs->pc = stack_pop();
+}
+
+void Interpreter::op_jp(const decoded_instruction &instr) {
+  // jumps to address NNN
+  regs->pc = instr.nnn;
+}
+
+void Interpreter::op_call(const decoded_instruction &instr) {
+  // calls subroutine at NNN
+  stack_push(regs->pc);
+  regs->pc = instr.nnn;
+}
+
+void Interpreter::op_se_vx_nn(const decoded_instruction &instr) {
+  // skips next instruction if VX == NN
+  if (regs->v[instr.x] == instr.nn) {
+    regs->pc += 2;
+  }
+}
+
+void Interpreter::op_sne_vx_nn(const decoded_instruction &instr) {
+  // skips next instruction if VX != NN
+  if (regs->v[instr.x] != instr.nn) {
+    regs->pc += 2;
+  }
+}
+
+void Interpreter::op_se_vx_vy(const decoded_instruction &instr) {
+  // skips next instruction if VX == VY
+  if (regs->v[instr.x] == regs->v[instr.y]) {
+    regs->pc += 2;
+  }
+}
+
+void Interpreter::op_ld_vx_nn(const decoded_instruction &instr) {
+  // sets VX to NN
+  regs->v[instr.x] = instr.nn;
+}
+
+void Interpreter::op_add_vx_nn(const decoded_instruction &instr) {
+  // adds NN to VX (carry flag not changed)
+  regs->v[instr.x] += instr.nn;
+}
+
+void Interpreter::op_ld_vx_vy(const decoded_instruction &instr) {
+  // sets VX to VY
+  regs->v[instr.x] = regs->v[instr.y];
+}
+
+void Interpreter::op_or_vx_vy(const decoded_instruction &instr) {
+  // sets VX to VX | VY
+  regs->v[0xf] = 0;
+  regs->v[instr.x] = regs->v[instr.x] | regs->v[instr.y];
+}
+
+void Interpreter::op_and_vx_vy(const decoded_instruction &instr) {
+  // sets VX to VX & VY
+  regs->v[0xf] = 0;
+  regs->v[instr.x] = regs->v[instr.x] & regs->v[instr.y];
+}
+
+void Interpreter::op_xor_vx_vy(const decoded_instruction &instr) {
+  // sets VX to VX xor VY
+  regs->v[0xf] = 0;
+  regs->v[instr.x] = regs->v[instr.x] xor regs->v[instr.y];
+}
+
+void Interpreter::op_add_vx_vy(const decoded_instruction &instr) {
+  // adds VY to VX, set VF to 1 if overflow else 0
+  uint16_t val = regs->v[instr.x] + regs->v[instr.y];
+  regs->v[instr.x] = val & 0xff;
+  regs->v[0xf] = val >> 8;
+}
+
+void Interpreter::op_sub_vx_vy(const decoded_instruction &instr) {
+  // subtract VY from VX, set VF to 0 if underflow else 1
+  uint8_t result = regs->v[instr.x] >= regs->v[instr.y] ? 1 : 0;
+  regs->v[instr.x] -= regs->v[instr.y];
+  regs->v[0xf] = result;
+}
+
+void Interpreter::op_shr_vx_vy(const decoded_instruction &instr) {
+  // store LSB of VX in VF, right shift VX by 1
+  regs->v[instr.x] = regs->v[instr.y];
+  uint8_t lsb = regs->v[instr.x] & 0x1;
+  regs->v[instr.x] >>= 1;
+  regs->v[0xf] = lsb;
+}
+
+void Interpreter::op_subn_vx_vy(const decoded_instruction &instr) {
+  // sets VX to VY - VX, set VF to 0 if underflow else 1
+  regs->v[instr.x] = regs->v[instr.y] - regs->v[instr.x];
+  regs->v[0xf] = regs->v[instr.y] >= regs->v[instr.x] ? 1 : 0;
+}
+
+void Interpreter::op_shl_vx_vy(const decoded_instruction &instr) {
+  // store MSB of VX in VF, left shift VX by 1
+  regs->v[instr.x] = regs->v[instr.y];
+  uint8_t msb = (regs->v[instr.x] & 0x8) >> 3;
+  regs->v[instr.x] <<= 1;
+  regs->v[0xf] = msb;
+}
+
+void Interpreter::op_sne_vx_vy(const decoded_instruction &instr) {
+  // skips next instruction if VX != VY
+  if (regs->v[instr.x] != regs->v[instr.y]) {
+    regs->pc += 2;
+  }
+}
+
+void Interpreter::op_ld_i(const decoded_instruction &instr) {
+  // sets I to NNN
+  regs->i = instr.nnn;
+}
+
+void Interpreter::op_jp_v0(const decoded_instruction &instr) {
+  // jumps to address NNN + V0
+  regs->pc = instr.nnn + regs->v[0];
+  // TODO: CHIP-48 & SUPER-CHIP - BXNN jump to XNN + VX
+}
+
+void Interpreter::op_rnd(const decoded_instruction &instr) {
+  // sets VX to rand() & NN
+  regs->v[instr.x] = rng.next_byte() & instr.nn;
+  side_effects += 1;
+}
+
+void Interpreter::op_drw(const decoded_instruction &instr) {
+  // draws sprite at coord (VX, VY)
+  screen_draw_sprite(regs->v[instr.x], regs->v[instr.y], instr.n);
+}
+
+void Interpreter::op_skp(const decoded_instruction &instr) {
+  // skips next instruction if key stored in VX is pressed
+  if (is_key_pressed(regs->v[instr.x])) {
+    regs->pc += 2;
+  }
+}
+
+void Interpreter::op_sknp(const decoded_instruction &instr) {
+  // skips next instruction if key stored in VX is not pressed
+  if (!is_key_pressed(regs->v[instr.x])) {
+    regs->pc += 2;
+  }
+}
+
+void Interpreter::op_ld_vx_dt(const decoded_instruction &instr) {
+  // sets VX to delay timer
+  regs->v[instr.x] = regs->dt;
+}
+
+bool Interpreter::op_ld_vx_k(const decoded_instruction &instr) {
+  // wait for keypress, store in VX
+  auto key = get_pressed_key();
+  if (!key.has_value()) {
+    regs->pc -= 2;
+    return false;
+  }
+  spdlog::debug("Key pressed: {}", key.value());
+  regs->v[instr.x] = key.value();
+  return true;
+}
+
+void Interpreter::op_ld_dt_vx(const decoded_instruction &instr) {
+  // set delay timer to VX
+  regs->dt = regs->v[instr.x];
+}
+
+void Interpreter::op_ld_st_vx(const decoded_instruction &instr) {
+  // set sound timer to VX
+  regs->st = regs->v[instr.x];
+}
+
+void Interpreter::op_add_i_vx(const decoded_instruction &instr) {
+  // adds VX to I, VF unchanged
+  regs->i += regs->v[instr.x];
+}
+
+void Interpreter::op_ld_f_vx(const decoded_instruction &instr) {
+  // sets I to for sprite character in VX
+  regs->i = get_font_sprite_addr(regs->v[instr.x]);
+}
+
+void Interpreter::op_ld_b_vx(const decoded_instruction &instr) {
+  // stores BCD repr of VX at address I
+  int i = regs->i;
+  uint8_t val = regs->v[instr.x];
+  write_memory(i, val / 100);
+  write_memory(i + 1, (val / 10) % 10);
+  write_memory(i + 2, val % 10);
+}
+
+void Interpreter::op_ld_i_vx(const decoded_instruction &instr) {
+  // stores V0 to VX (inclusive) in memory starting at address I
+  for (int xn = 0, i = regs->i; xn <= instr.x; i++, xn++) {
+    write_memory(i, regs->v[xn]);
+    // classic chip-8 quirk:
+    regs->i += 1;
+  }
+}
+
+void Interpreter::op_ld_vx_i(const decoded_instruction &instr) {
+  // fills V0 to VX (inclusive) with values from memory starting at I
+  for (int xn = 0, i = regs->i; xn <= instr.x; xn++, i++) {
+    regs->v[xn] = regs->mem[i & (kMemSize - 1)];
+    // classic chip-8 quirk:
+    regs->i += 1;
+  }
+}
+
+ACE_COLD void Interpreter::op_invalid(const decoded_instruction &instr) {
+  if ((instr.instr >> 12) == 0x0) {
+    // call machine routine at NNN
+    // unimplemented
+    spdlog::warn("Unimplemented instruction 0NNN: {:x}", instr.nnn);
+  } else {
+    spdlog::warn("Invalid instruction: {:x}", instr.instr);
+  }
+}
+
+void Interpreter::begin_frame() {
+  if (input_callback) {
+    input_callback(cycles);
+  }
+  update_keyboard();
+  reset_idle_probe();
+
+  int rate = std::max(update_play_rate, 1);
+  frame_remaining = rate / kTimerRate;
+  frame_remainder += rate % kTimerRate;
+  if (frame_remainder >= kTimerRate) {
+    frame_remainder -= kTimerRate;
+    frame_remaining += 1;
+  }
+  frame_quota = frame_remaining;
+}
+
+void Interpreter::end_frame() {
+  update_timers();
+  stats.frames += 1;
+  cycles += frame_quota;
+  begin_frame();
+
+  if (frame_callback) {
+    frame_callback();
+  }
+}
+
+void Interpreter::update_timers() {
+  if (regs->dt > 0) {
+    regs->dt -= 1;
+  }
+  if (regs->st > 0) {
+    regs->st -= 1;
   }
 }
 
@@ -320,14 +1178,16 @@ void Interpreter::stack_push(uint16_t val) {
   spdlog::trace("Push stack: {}", val);
   uint8_t *sp = &regs->mem[kStackPtrIndex];
   auto stack = reinterpret_cast<uint16_t *>(&regs->mem[kStackStartIndex]);
+  invalidate_memory(kStackStartIndex + (*sp * 2), 2);
   stack[(*sp)++] = val;
-
+  invalidate_memory(kStackPtrIndex);
 }
 
 uint16_t Interpreter::stack_pop() {
   spdlog::trace("Pop stack");
   uint8_t *sp = &regs->mem[kStackPtrIndex];
   auto stack = reinterpret_cast<uint16_t *>(&regs->mem[kStackStartIndex]);
+  invalidate_memory(kStackPtrIndex);
   return stack[--(*sp)];
 }
 
@@ -352,12 +1212,18 @@ std::optional<uint8_t> Interpreter::get_pressed_key() {
   return std::nullopt;
 }
 
-bool Interpreter::is_key_pressed(uint8_t key) { return regs->kbd[key]; }
+bool Interpreter::is_key_pressed(uint8_t key) {
+  return regs->kbd[key & (kKeyboardSize - 1)];
+}
 
 void Interpreter::screen_clear() {
   spdlog::trace("Clear screen");
-  for (int i = 0; i < regs->screen.size(); i += 1) {
-    regs->screen[i] = false;
+  for (screen_row row : regs->screen) {
+    if (row) {
+      regs->screen.fill(0);
+      regs->screen_generation += 1;
+      break;
+    }
   }
 }
 
@@ -367,90 +1233,39 @@ void Interpreter::screen_draw_sprite(int x, int y, int n) {
 
   regs->v[0xf] = 0;
 
+  // sprite rows land one pixel right of x, anything past the edge is clipped
+  int shift = x + 1;
+  if (shift >= kScreenWidth) {
+    return;
+  }
+
+  screen_row changed = 0;
   for (int j = 0; j < n; j += 1) {
-    int sx = x + 8;
     int sy = y + j;
-    uint8_t row = regs->mem[regs->i + j];
-
     if (sy >= kScreenHeight) {
       break;
     }
 
-    for (int b = 0; b < 8; b += 1) {
-      if (row & 1 && sx < kScreenWidth) {
-        screen_flip_pixel_at(sx, sy);
-      }
+    screen_row sprite = screen_row{regs->mem[(regs->i + j) & (kMemSize - 1)]}
+                        << (kScreenWidth - 8);
+    screen_row bits = sprite >> shift;
 
-      row >>= 1;
-      sx -= 1;
+    if (regs->screen[sy] & bits) {
+      regs->v[0xf] = 1;
     }
+    regs->screen[sy] ^= bits;
+    changed |= bits;
   }
-}
 
-void Interpreter::screen_flip_pixel_at(int x, int y) {
-  int idx = (y * kScreenWidth) + x;
-  regs->screen[idx] = !regs->screen[idx];
-  if (!regs->screen[idx]) {
-    regs->v[0xf] = 1;
+  if (changed) {
+    regs->screen_generation += 1;
   }
 }
 
 void Interpreter::init_font_sprites() {
-  uint16_t idx = kFontStartIndex;
-
-  auto load_sprite = [&](std::array<uint8_t, 5> bytes) {
-    for (int i = 0; i < 5; i += 1) {
-      regs->mem[idx++] = bytes[i];
-    }
-  };
-
-  // 0
-  load_sprite({0xf0, 0x90, 0x90, 0x90, 0xf0});
-
-  // 1
-  load_sprite({0x20, 0x60, 0x20, 0x20, 0x70});
-
-  // 2
-  load_sprite({0xf0, 0x10, 0xf0, 0x80, 0xf0});
-
-  // 3
-  load_sprite({0xf0, 0x10, 0xf0, 0x10, 0xf0});
-
-  // 4
-  load_sprite({0x90, 0x90, 0xf0, 0x10, 0x10});
-
-  // 5
-  load_sprite({0xf0, 0x80, 0xf0, 0x10, 0xf0});
-
-  // 6
-  load_sprite({0xf0, 0x80, 0xf0, 0x90, 0xf0});
-
-  // 7
-  load_sprite({0xf0, 0x10, 0x20, 0x40, 0x40});
-
-  // 8
-  load_sprite({0xf0, 0x90, 0xf0, 0x90, 0xf0});
-
-  // 9
-  load_sprite({0xf0, 0x90, 0xf0, 0x10, 0xf0});
-
-  // A
-  load_sprite({0xf0, 0x90, 0xf0, 0x90, 0x90});
-
-  // B
-  load_sprite({0xe0, 0x90, 0xe0, 0x90, 0xe0});
-
-  // C
-  load_sprite({0xf0, 0x80, 0x80, 0x80, 0xf0});
-
-  // D
-  load_sprite({0xe0, 0x90, 0x90, 0x90, 0xe0});
-
-  // E
-  load_sprite({0xf0, 0x80, 0xf0, 0x80, 0xf0});
-
-  // F
-  load_sprite({0xf0, 0x80, 0xf0, 0x80, 0x80});
+  for (size_t idx = 0; idx < kFontSprites.size(); idx += 1) {
+    write_memory(kFontStartIndex + idx, kFontSprites[idx]);
+  }
 }
 
 uint16_t Interpreter::get_font_sprite_addr(uint8_t c) {
@@ -1,17 +1,143 @@
 #pragma once
 
+#include "random.h"
+#include "recompiler.h"
 #include "registers.h"
 #include "timer.h"
 
+#include <bitset>
+#include <functional>
 #include <memory>
 #include <optional>
 
-const double kTimerFrequency = 1.0 / 60.0;
+const int kTimerRate = 60;
+const double kTimerFrequency = 1.0 / kTimerRate;
 const int kDefaultPlayingUpdateRate = 1200;
+const int kDefaultMaxCatchUpFrames = 6;
+// wall-clock time an unthrottled update() may spend running frames
+const double kUnthrottledTimeSlice = 1.0 / 240.0;
+// most frames a single DT polling loop may be jumped over at once
+const int kMaxElidedFrames = 600;
+// backward jumps between idle probes once a loop keeps changing state
+const int kMaxIdleProbeInterval = 64;
+
+enum class backend_type {
+  interpreter,
+  recompiler,
+};
+
+enum class opcode : uint8_t {
+  undecoded,
+  cls,
+  ret,
+  jp,
+  call,
+  se_vx_nn,
+  sne_vx_nn,
+  se_vx_vy,
+  ld_vx_nn,
+  add_vx_nn,
+  ld_vx_vy,
+  or_vx_vy,
+  and_vx_vy,
+  xor_vx_vy,
+  add_vx_vy,
+  sub_vx_vy,
+  shr_vx_vy,
+  subn_vx_vy,
+  shl_vx_vy,
+  sne_vx_vy,
+  ld_i,
+  jp_v0,
+  rnd,
+  drw,
+  skp,
+  sknp,
+  ld_vx_dt,
+  ld_vx_k,
+  ld_dt_vx,
+  ld_st_vx,
+  add_i_vx,
+  ld_f_vx,
+  ld_b_vx,
+  ld_i_vx,
+  ld_vx_i,
+  breakpoint,
+  invalid,
+};
+
+enum class stop_reason {
+  budget_exhausted,
+  waiting_for_key,
+  breakpoint,
+  invalid_instruction,
+  screen_drawn,
+  idle,
+};
+
+struct run_result {
+  stop_reason reason = stop_reason::budget_exhausted;
+  int executed = 0;
+};
+
+struct scheduler_stats {
+  uint64_t frames = 0;
+  uint64_t instructions = 0;
+  // instructions skipped in provably idle loops or spent waiting on FX0A
+  uint64_t idle_instructions = 0;
+  // whole frames jumped over while polling DT, see run_frames()
+  uint64_t elided_frames = 0;
+  // frames skipped because the host fell behind by more than the catch-up cap
+  uint64_t dropped_frames = 0;
+};
+
+// Machine state at the head of a backward jump. Arriving at the same head
+// with the same state and no side effects in between means the guest loops
+// until something outside of it (the next frame or a key) changes.
+struct idle_probe {
+  // pc, i, dt, st and v packed straight out of registers
+  std::array<uint64_t, 3> regs{0};
+  uint64_t effects = 0;
+  uint64_t at = 0;
+};
+
+// Interpreter state that lives outside of registers, everything a save state
+// needs on top of them to resume mid-frame exactly where it left off.
+struct interpreter_state {
+  std::array<bool, kKeyboardSize> key_down{false};
+  std::array<bool, kKeyboardSize> key_released{false};
+  int frame_remaining = 0;
+  int frame_remainder = 0;
+  int frame_quota = 0;
+  // instruction slots of all finished frames
+  uint64_t cycles = 0;
+  Random::state_type rng{0};
+  uint32_t seed = 0;
+  bool playing = false;
+
+  // instruction slots since reset, one per instruction or idle spin
+  inline uint64_t cycle() const { return cycles + frame_quota - frame_remaining; }
+};
+
+class MachineFork;
+
+struct decoded_instruction {
+  opcode op = opcode::undecoded;
+  uint16_t instr = 0;
+  uint16_t nnn = 0;
+  uint8_t x = 0;
+  uint8_t y = 0;
+  uint8_t n = 0;
+  uint8_t nn = 0;
+};
 
 class Interpreter {
 public:
   int update_play_rate = kDefaultPlayingUpdateRate;
+  int max_catch_up_frames = kDefaultMaxCatchUpFrames;
+  // guest seconds per host second, ignored when unthrottled
+  double speed = 1.0;
+  bool unthrottled = false;
 
 public:
   explicit Interpreter(std::shared_ptr<registers> regs);
@@ -21,33 +147,145 @@ public:
   void cleanup();
 
   void load_rom_bytes(const std::vector<uint8_t> &bytes);
+  void invalidate_memory(uint16_t addr, size_t len = 1);
 
   void reset();
   void step();
+  run_result run(int budget);
+  bool run_frame();
+  // Runs count frames back to back, jumping straight over frames the guest
+  // spends polling DT. Returns the number of frames run, short on a breakpoint.
+  int run_frames(int count);
   void play();
   void stop();
 
   bool is_playing() const;
 
+  void set_backend(backend_type type);
+  backend_type get_backend() const;
+
+  void set_breakpoint(uint16_t addr, bool enabled);
+  bool has_breakpoint(uint16_t addr) const;
+
+  const scheduler_stats &get_stats() const;
+
+  uint64_t get_cycle() const;
+
+  // seeds CXNN on every reset, unset draws a fresh seed each time
+  void set_seed(std::optional<uint32_t> seed);
+  // seed the current run started from
+  uint32_t get_seed() const;
+  // called at every frame boundary, including elided frames
+  void set_frame_callback(std::function<void()> callback);
+  // called at every frame boundary before the keypad is sampled, with the
+  // cycle the new frame starts at
+  void set_input_callback(std::function<void(uint64_t cycle)> callback);
+
+  void save_state(interpreter_state &state) const;
+  // registers must already hold the matching machine state
+  void load_state(const interpreter_state &state);
+
+  // Captures the running machine into child. Memory pages unchanged since
+  // the last fork are shared with it rather than copied.
+  void fork(MachineFork &child);
+  // Continues from a fork, copying in only the memory pages that differ from
+  // what this interpreter holds. Cheap when switching between forks of one
+  // machine, which mostly share their pages.
+  void resume(const MachineFork &fork);
+
 private:
+  run_result interpret(int budget);
+  run_result dispatch(int budget);
+  bool probe_idle(uint64_t now);
+  void reset_idle_probe();
+  int elide_timer_wait(int max_frames);
+  decoded_instruction decode(uint16_t addr) const;
+  void write_memory(uint16_t addr, uint8_t val);
+  void invalidate_all();
+  void apply_state(const interpreter_state &state);
+
+  void op_cls(const decoded_instruction &instr);
+  void op_ret(const decoded_instruction &instr);
+  void op_jp(const decoded_instruction &instr);
+  void op_call(const decoded_instruction &instr);
+  void op_se_vx_nn(const decoded_instruction &instr);
+  void op_sne_vx_nn(const decoded_instruction &instr);
+  void op_se_vx_vy(const decoded_instruction &instr);
+  void op_ld_vx_nn(const decoded_instruction &instr);
+  void op_add_vx_nn(const decoded_instruction &instr);
+  void op_ld_vx_vy(const decoded_instruction &instr);
+  void op_or_vx_vy(const decoded_instruction &instr);
+  void op_and_vx_vy(const decoded_instruction &instr);
+  void op_xor_vx_vy(const decoded_instruction &instr);
+  void op_add_vx_vy(const decoded_instruction &instr);
+  void op_sub_vx_vy(const decoded_instruction &instr);
+  void op_shr_vx_vy(const decoded_instruction &instr);
+  void op_subn_vx_vy(const decoded_instruction &instr);
+  void op_shl_vx_vy(const decoded_instruction &instr);
+  void op_sne_vx_vy(const decoded_instruction &instr);
+  void op_ld_i(const decoded_instruction &instr);
+  void op_jp_v0(const decoded_instruction &instr);
+  void op_rnd(const decoded_instruction &instr);
+  void op_drw(const decoded_instruction &instr);
+  void op_skp(const decoded_instruction &instr);
+  void op_sknp(const decoded_instruction &instr);
+  void op_ld_vx_dt(const decoded_instruction &instr);
+  bool op_ld_vx_k(const decoded_instruction &instr);
+  void op_ld_dt_vx(const decoded_instruction &instr);
+  void op_ld_st_vx(const decoded_instruction &instr);
+  void op_add_i_vx(const decoded_instruction &instr);
+  void op_ld_f_vx(const decoded_instruction &instr);
+  void op_ld_b_vx(const decoded_instruction &instr);
+  void op_ld_i_vx(const decoded_instruction &instr);
+  void op_ld_vx_i(const decoded_instruction &instr);
+  void op_invalid(const decoded_instruction &instr);
+
+  void begin_frame();
+  void end_frame();
   void update_keyboard();
-  void update_timers(double dt);
+  void update_timers();
   void stack_push(uint16_t val);
   uint16_t stack_pop();
   void screen_clear();
   void screen_draw_sprite(int x, int y, int n);
-  void screen_flip_pixel_at(int x, int y);
   std::optional<uint8_t> get_pressed_key();
   bool is_key_pressed(uint8_t key);
   void init_font_sprites();
   uint16_t get_font_sprite_addr(uint8_t c);
 
   Timer timer;
-  double last_tick = 0;
-  double last_update = 0;
+  double pending_time = 0;
   bool playing = false;
 
+  // instructions left before the next 60 Hz timer tick, with the
+  // update_play_rate % 60 remainder spread over frames Bresenham-style
+  int frame_remaining = 0;
+  int frame_remainder = 0;
+  int frame_quota = 0;
+  uint64_t cycles = 0;
+  scheduler_stats stats;
+
+  Random rng;
+  std::optional<uint32_t> fixed_seed;
+  uint32_t seed = 0;
+  std::function<void()> frame_callback;
+  std::function<void(uint64_t cycle)> input_callback;
+
+  // bumped by memory writes and RND, anything the idle probe can't compare
+  uint32_t side_effects = 0;
+  idle_probe probe;
+  int idle_probe_interval = 1;
+  int idle_probe_countdown = 1;
+  int idle_period = 0;
+
   std::shared_ptr<registers> regs;
+  std::array<decoded_instruction, kMemSize> decoded{};
+  std::unique_ptr<Recompiler> recompiler;
+  std::bitset<kMemSize> breakpoints;
+  // memory as last handed to or taken from a fork, a page is stale once
+  // memory under it changed
+  std::shared_ptr<memory_page_table> fork_pages;
+  std::bitset<kMemPageCount> stale_pages;
   std::array<bool, kKeyboardSize> key_down{false};
   std::array<bool, kKeyboardSize> key_released{false};
 };
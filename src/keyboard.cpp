@@ -1,4 +1,5 @@
 #include "keyboard.h"
+#include "emulator.h"
 
 #include <spdlog/spdlog.h>
 #include <raylib.h>
@@ -28,13 +29,19 @@ Keyboard::Keyboard() {
   mapping.push_back({"F", KEY_V, 0xf});
 }
 
-void Keyboard::initialize(std::shared_ptr<registers> regs_) {
+void Keyboard::initialize(std::shared_ptr<registers> regs_, Emulator *emulator_) {
   regs = std::move(regs_);
+  emulator = emulator_;
 }
 
 void Keyboard::update() {
   for (auto &m : mapping) {
-    regs->kbd[m.key] = IsKeyDown(m.keycode);
+    bool down = IsKeyDown(m.keycode);
+    if (down != pressed[m.key]) {
+      pressed[m.key] = down;
+      emulator->send({emulator_command_type::set_key, m.key, down});
+    }
+    regs->kbd[m.key] = down;
   }
 }
 
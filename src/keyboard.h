@@ -1,6 +1,8 @@
 #pragma once
 
 #include "registers.h"
+
+#include <memory>
 #include <vector>
 #include <string>
 
@@ -10,15 +12,19 @@ struct key_mapping {
   uint8_t key;
 };
 
+class Emulator;
+
 class Keyboard {
 public:
   Keyboard();
 
-  void initialize(std::shared_ptr<registers> regs);
+  void initialize(std::shared_ptr<registers> regs, Emulator *emulator);
   void update();
   void draw();
 
 private:
   std::vector<key_mapping> mapping;
   std::shared_ptr<registers> regs;
+  Emulator *emulator = nullptr;
+  std::array<bool, kKeyboardSize> pressed{false};
 };
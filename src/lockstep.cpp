@@ -0,0 +1,800 @@
+#include "lockstep.h"
+#include "hash.h"
+#include "headless.h"
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <spdlog/spdlog.h>
+
+// The lane loops are written to be vectorized by the compiler. On x86-64
+// Linux the functions running them are also built for AVX2 and picked at
+// load time, everywhere else they get the baseline instruction set.
+#if defined(__x86_64__) && defined(__linux__) && defined(__has_attribute)
+#if __has_attribute(target_clones)
+#define ACE_LANE_KERNEL __attribute__((target_clones("avx2", "default")))
+#endif
+#endif
+#ifndef ACE_LANE_KERNEL
+#define ACE_LANE_KERNEL
+#endif
+
+// Lanes never touch each other's entries, which the compiler can't prove
+// about columns of the same array. Saying so spares the runtime alias checks
+// that the cheaper vectorizer cost models refuse to emit.
+#if defined(__clang__)
+#define ACE_EACH_LANE _Pragma("clang loop vectorize(assume_safety)")
+#elif defined(__GNUC__)
+#define ACE_EACH_LANE _Pragma("GCC ivdep")
+#else
+#define ACE_EACH_LANE
+#endif
+
+namespace {
+
+constexpr uint16_t kAddrMask = kMemSize - 1;
+// larger than any PC, marks lanes that are done for the frame
+constexpr uint32_t kNoPc = 0x10000;
+
+inline uint8_t blend(uint8_t val, uint8_t old, uint8_t mask) {
+  return (val & mask) | (old & ~mask);
+}
+
+inline uint16_t blend16(uint16_t val, uint16_t old, uint8_t mask) {
+  uint16_t wide = -static_cast<uint16_t>(mask & 1);
+  return (val & wide) | (old & ~wide);
+}
+
+inline uint32_t blend32(uint32_t val, uint32_t old, uint8_t mask) {
+  uint32_t wide = -static_cast<uint32_t>(mask & 1);
+  return (val & wide) | (old & ~wide);
+}
+
+inline uint32_t rotl(uint32_t x, int k) { return (x << k) | (x >> (32 - k)); }
+
+// Keypad input for the reference check, sparse and different per lane
+uint16_t verify_keys(size_t lane, uint64_t cycle) {
+  uint64_t lane_id = lane;
+  uint64_t hash = hash_bytes(&cycle, sizeof(cycle),
+                             hash_bytes(&lane_id, sizeof(lane_id)));
+  return hash & (hash >> 16) & (hash >> 32);
+}
+
+} // namespace
+
+LockstepEngine::LockstepEngine(size_t lanes)
+    : count(std::max<size_t>(lanes, 1)),
+      stride((count + kLockstepLaneAlign - 1) / kLockstepLaneAlign *
+             kLockstepLaneAlign),
+      v(kGeneralRegisterCount * stride), pc(stride), i(stride), dt(stride),
+      st(stride), rng(4 * stride), kbd(stride), key_down(stride),
+      key_released(stride), remaining(stride), mem(count * kMemSize),
+      screen(count * kScreenHeight), group(stride), all_lanes(stride) {
+  std::fill(all_lanes.begin(), all_lanes.begin() + count, 0xff);
+}
+
+size_t LockstepEngine::lanes() const { return count; }
+
+void LockstepEngine::reset(uint32_t first_seed) {
+  std::fill(v.begin(), v.end(), 0);
+  std::fill(i.begin(), i.end(), 0);
+  std::fill(dt.begin(), dt.end(), 0);
+  std::fill(st.begin(), st.end(), 0);
+  std::fill(kbd.begin(), kbd.end(), 0);
+  std::fill(key_down.begin(), key_down.end(), 0);
+  std::fill(key_released.begin(), key_released.end(), 0);
+  std::fill(mem.begin(), mem.end(), 0);
+  std::fill(screen.begin(), screen.end(), 0);
+
+  for (size_t lane = 0; lane < count; lane += 1) {
+    std::copy(kFontSprites.begin(), kFontSprites.end(),
+              lane_mem(lane) + kFontStartIndex);
+
+    Random random(first_seed + static_cast<uint32_t>(lane));
+    const Random::state_type &state = random.get_state();
+    for (int word = 0; word < 4; word += 1) {
+      rng[word * stride + lane] = state[word];
+    }
+  }
+  written.reset();
+
+  converged = true;
+  shared_pc = kRomStartIndex;
+  frame_remainder = 0;
+  cycles = 0;
+  stats = {};
+  begin_frame();
+}
+
+void LockstepEngine::load_rom_bytes(const std::vector<uint8_t> &bytes) {
+  size_t size = std::min<size_t>(bytes.size(), kMemSize - kRomStartIndex);
+  for (size_t lane = 0; lane < count; lane += 1) {
+    std::copy(bytes.begin(), bytes.begin() + size,
+              lane_mem(lane) + kRomStartIndex);
+  }
+}
+
+void LockstepEngine::run_frames(int count_) {
+  for (int frame = 0; frame < count_; frame += 1) {
+    run_frame();
+  }
+}
+
+void LockstepEngine::set_keys(size_t lane, uint16_t keys) {
+  if (lane < count) {
+    kbd[lane] = keys;
+  }
+}
+
+void LockstepEngine::set_input_callback(
+    std::function<void(uint64_t cycle)> callback) {
+  input_callback = std::move(callback);
+}
+
+uint64_t LockstepEngine::get_cycle() const {
+  int left = converged ? shared_remaining
+                       : *std::max_element(remaining.begin(), remaining.end());
+  return cycles + frame_quota - left;
+}
+
+const lockstep_stats &LockstepEngine::get_stats() const { return stats; }
+
+void LockstepEngine::get_registers(size_t lane, registers &out) const {
+  out.pc = converged ? shared_pc : pc[lane];
+  out.i = i[lane];
+  out.dt = dt[lane];
+  out.st = st[lane];
+  for (int reg = 0; reg < kGeneralRegisterCount; reg += 1) {
+    out.v[reg] = v[reg * stride + lane];
+  }
+  std::copy_n(lane_mem(lane), kMemSize, out.mem.begin());
+  for (int key = 0; key < kKeyboardSize; key += 1) {
+    out.kbd[key] = (kbd[lane] >> key) & 1;
+  }
+  std::copy_n(screen.begin() + lane * kScreenHeight, kScreenHeight,
+              out.screen.begin());
+}
+
+Random::state_type LockstepEngine::get_rng_state(size_t lane) const {
+  return {rng[lane], rng[stride + lane], rng[2 * stride + lane],
+          rng[3 * stride + lane]};
+}
+
+ACE_LANE_KERNEL void LockstepEngine::begin_frame() {
+  const size_t width = stride;
+  if (input_callback) {
+    input_callback(cycles);
+  }
+
+  ACE_EACH_LANE
+  for (size_t lane = 0; lane < width; lane += 1) {
+    key_released[lane] = key_down[lane] & ~kbd[lane];
+    key_down[lane] = kbd[lane];
+  }
+
+  int rate = std::max(update_play_rate, 1);
+  frame_quota = rate / kTimerRate;
+  frame_remainder += rate % kTimerRate;
+  if (frame_remainder >= kTimerRate) {
+    frame_remainder -= kTimerRate;
+    frame_quota += 1;
+  }
+
+  if (converged) {
+    shared_remaining = frame_quota;
+  } else {
+    ACE_EACH_LANE
+    for (size_t lane = 0; lane < width; lane += 1) {
+      remaining[lane] = lane < count ? frame_quota : 0;
+    }
+    try_converge();
+  }
+}
+
+ACE_LANE_KERNEL void LockstepEngine::end_frame() {
+  const size_t width = stride;
+  ACE_EACH_LANE
+  for (size_t lane = 0; lane < width; lane += 1) {
+    dt[lane] -= dt[lane] > 0;
+    st[lane] -= st[lane] > 0;
+  }
+  stats.frames += 1;
+  stats.instructions += static_cast<uint64_t>(frame_quota) * count;
+  cycles += frame_quota;
+  begin_frame();
+}
+
+void LockstepEngine::run_frame() {
+  while (true) {
+    if (converged) {
+      run_converged();
+      if (converged) {
+        break;
+      }
+    }
+    if (!run_divergent_group()) {
+      break;
+    }
+  }
+  end_frame();
+}
+
+void LockstepEngine::run_converged() {
+  while (shared_remaining > 0) {
+    uint16_t addr = shared_pc;
+    uint16_t instr = fetch(0, addr);
+    if (written[addr & kAddrMask] || written[(addr + 1) & kAddrMask]) {
+      for (size_t lane = 1; lane < count; lane += 1) {
+        if (fetch(lane, addr) != instr) {
+          diverge();
+          return;
+        }
+      }
+    }
+
+    shared_pc += 2;
+    shared_remaining -= 1;
+    stats.groups += 1;
+
+    switch (instr >> 12) {
+    case 0x1:
+      shared_pc = instr & 0xfff;
+      break;
+    case 0x2:
+      for (size_t lane = 0; lane < count; lane += 1) {
+        stack_push(lane, shared_pc);
+      }
+      shared_pc = instr & 0xfff;
+      break;
+    case 0x0:
+      if (instr != 0x00ee) {
+        execute(instr, all_lanes.data());
+        break;
+      }
+      // returns may differ per lane
+      [[fallthrough]];
+    case 0x3:
+    case 0x4:
+    case 0x5:
+    case 0x9:
+    case 0xb:
+    case 0xe:
+      // branches may send each lane somewhere else
+      diverge();
+      execute(instr, all_lanes.data());
+      try_converge();
+      if (!converged) {
+        return;
+      }
+      break;
+    case 0xf:
+      if ((instr & 0xff) == 0x0a) {
+        diverge();
+        execute(instr, all_lanes.data());
+        try_converge();
+        if (!converged) {
+          return;
+        }
+        break;
+      }
+      execute(instr, all_lanes.data());
+      break;
+    default:
+      execute(instr, all_lanes.data());
+      break;
+    }
+  }
+}
+
+// Runs the group at the lowest PC among the lanes with instructions left,
+// false once every lane is done with the frame.
+ACE_LANE_KERNEL bool LockstepEngine::run_divergent_group() {
+  const size_t width = stride;
+  uint32_t lowest = kNoPc;
+  ACE_EACH_LANE
+  for (size_t lane = 0; lane < width; lane += 1) {
+    uint32_t key = remaining[lane] > 0 ? pc[lane] : kNoPc;
+    lowest = std::min(lowest, key);
+  }
+  if (lowest == kNoPc) {
+    return false;
+  }
+
+  uint16_t addr = static_cast<uint16_t>(lowest);
+  size_t leader = 0;
+  while (remaining[leader] <= 0 || pc[leader] != addr) {
+    leader += 1;
+  }
+  uint16_t instr = fetch(leader, addr);
+
+  ACE_EACH_LANE
+  for (size_t lane = 0; lane < width; lane += 1) {
+    group[lane] = (remaining[lane] > 0 && pc[lane] == addr) ? 0xff : 0;
+  }
+  if (written[addr & kAddrMask] || written[(addr + 1) & kAddrMask]) {
+    // lanes that rewrote this code wait for a group of their own
+    for (size_t lane = leader + 1; lane < count; lane += 1) {
+      if (group[lane] && fetch(lane, addr) != instr) {
+        group[lane] = 0;
+      }
+    }
+  }
+
+  size_t members = 0;
+  ACE_EACH_LANE
+  for (size_t lane = 0; lane < width; lane += 1) {
+    pc[lane] += group[lane] & 2;
+    remaining[lane] -= group[lane] & 1;
+    members += group[lane] & 1;
+  }
+
+  stats.groups += 1;
+  stats.divergent_groups += 1;
+  execute(instr, group.data());
+
+  if (members == count) {
+    try_converge();
+  }
+  return true;
+}
+
+void LockstepEngine::diverge() {
+  std::fill(pc.begin(), pc.begin() + count, shared_pc);
+  std::fill(remaining.begin(), remaining.begin() + count, shared_remaining);
+  std::fill(remaining.begin() + count, remaining.end(), 0);
+  converged = false;
+}
+
+ACE_LANE_KERNEL void LockstepEngine::try_converge() {
+  const size_t used = count;
+  uint16_t first_pc = pc[0];
+  int32_t first_remaining = remaining[0];
+  bool same = true;
+  for (size_t lane = 1; lane < used; lane += 1) {
+    same &= pc[lane] == first_pc && remaining[lane] == first_remaining;
+  }
+  if (same) {
+    converged = true;
+    shared_pc = first_pc;
+    shared_remaining = first_remaining;
+  }
+}
+
+// Mirrors Interpreter's op_* functions, quirks included, so both produce the
+// same machine state.
+ACE_LANE_KERNEL void LockstepEngine::execute(uint16_t instr,
+                                             const uint8_t *mask) {
+  // loop bounds live in locals, stores through the byte columns could alias
+  // the members and keep the loops from being vectorized
+  const size_t width = stride;
+  const int x = (instr >> 8) & 0xf;
+  const int y = (instr >> 4) & 0xf;
+  const int n = instr & 0xf;
+  const uint8_t nn = instr & 0xff;
+  const uint16_t nnn = instr & 0xfff;
+
+  uint8_t *vx = column(x);
+  uint8_t *vy = column(y);
+  uint8_t *vf = column(0xf);
+
+  switch (instr >> 12) {
+  case 0x0:
+    if (instr == 0x00e0) {
+      for (size_t lane = 0; lane < count; lane += 1) {
+        if (mask[lane]) {
+          std::fill_n(screen.begin() + lane * kScreenHeight, kScreenHeight, 0);
+        }
+      }
+    } else if (instr == 0x00ee) {
+      for (size_t lane = 0; lane < count; lane += 1) {
+        if (mask[lane]) {
+          pc[lane] = stack_pop(lane);
+        }
+      }
+    }
+    // 0NNN machine routines are unimplemented
+    break;
+  case 0x1:
+    ACE_EACH_LANE
+    for (size_t lane = 0; lane < width; lane += 1) {
+      pc[lane] = blend16(nnn, pc[lane], mask[lane]);
+    }
+    break;
+  case 0x2:
+    for (size_t lane = 0; lane < count; lane += 1) {
+      if (mask[lane]) {
+        stack_push(lane, pc[lane]);
+        pc[lane] = nnn;
+      }
+    }
+    break;
+  case 0x3:
+    ACE_EACH_LANE
+    for (size_t lane = 0; lane < width; lane += 1) {
+      pc[lane] += mask[lane] & (vx[lane] == nn ? 2 : 0);
+    }
+    break;
+  case 0x4:
+    ACE_EACH_LANE
+    for (size_t lane = 0; lane < width; lane += 1) {
+      pc[lane] += mask[lane] & (vx[lane] != nn ? 2 : 0);
+    }
+    break;
+  case 0x5:
+    ACE_EACH_LANE
+    for (size_t lane = 0; lane < width; lane += 1) {
+      pc[lane] += mask[lane] & (vx[lane] == vy[lane] ? 2 : 0);
+    }
+    break;
+  case 0x6:
+    ACE_EACH_LANE
+    for (size_t lane = 0; lane < width; lane += 1) {
+      vx[lane] = blend(nn, vx[lane], mask[lane]);
+    }
+    break;
+  case 0x7:
+    ACE_EACH_LANE
+    for (size_t lane = 0; lane < width; lane += 1) {
+      vx[lane] = blend(vx[lane] + nn, vx[lane], mask[lane]);
+    }
+    break;
+  case 0x8:
+    switch (n) {
+    case 0x0:
+      ACE_EACH_LANE
+      for (size_t lane = 0; lane < width; lane += 1) {
+        vx[lane] = blend(vy[lane], vx[lane], mask[lane]);
+      }
+      break;
+    case 0x1:
+    case 0x2:
+    case 0x3:
+      // VF is cleared before VX and VY are read
+      ACE_EACH_LANE
+      for (size_t lane = 0; lane < width; lane += 1) {
+        vf[lane] = blend(0, vf[lane], mask[lane]);
+      }
+      if (n == 0x1) {
+        ACE_EACH_LANE
+        for (size_t lane = 0; lane < width; lane += 1) {
+          vx[lane] = blend(vx[lane] | vy[lane], vx[lane], mask[lane]);
+        }
+      } else if (n == 0x2) {
+        ACE_EACH_LANE
+        for (size_t lane = 0; lane < width; lane += 1) {
+          vx[lane] = blend(vx[lane] & vy[lane], vx[lane], mask[lane]);
+        }
+      } else {
+        ACE_EACH_LANE
+        for (size_t lane = 0; lane < width; lane += 1) {
+          vx[lane] = blend(vx[lane] ^ vy[lane], vx[lane], mask[lane]);
+        }
+      }
+      break;
+    case 0x4:
+      ACE_EACH_LANE
+      for (size_t lane = 0; lane < width; lane += 1) {
+        uint16_t sum = vx[lane] + vy[lane];
+        vx[lane] = blend(sum & 0xff, vx[lane], mask[lane]);
+        vf[lane] = blend(sum >> 8, vf[lane], mask[lane]);
+      }
+      break;
+    case 0x5:
+      ACE_EACH_LANE
+      for (size_t lane = 0; lane < width; lane += 1) {
+        uint8_t flag = vx[lane] >= vy[lane] ? 1 : 0;
+        vx[lane] = blend(vx[lane] - vy[lane], vx[lane], mask[lane]);
+        vf[lane] = blend(flag, vf[lane], mask[lane]);
+      }
+      break;
+    case 0x6:
+      ACE_EACH_LANE
+      for (size_t lane = 0; lane < width; lane += 1) {
+        uint8_t val = vy[lane];
+        vx[lane] = blend(val >> 1, vx[lane], mask[lane]);
+        vf[lane] = blend(val & 0x1, vf[lane], mask[lane]);
+      }
+      break;
+    case 0x7:
+      // VF compares against VY as it is after VX was written
+      ACE_EACH_LANE
+      for (size_t lane = 0; lane < width; lane += 1) {
+        uint8_t val = vy[lane] - vx[lane];
+        uint8_t after = x == y ? val : vy[lane];
+        vx[lane] = blend(val, vx[lane], mask[lane]);
+        vf[lane] = blend(after >= val ? 1 : 0, vf[lane], mask[lane]);
+      }
+      break;
+    case 0xe:
+      // the flag is bit 3, as in Interpreter::op_shl_vx_vy
+      ACE_EACH_LANE
+      for (size_t lane = 0; lane < width; lane += 1) {
+        uint8_t val = vy[lane];
+        vx[lane] = blend(val << 1, vx[lane], mask[lane]);
+        vf[lane] = blend((val & 0x8) >> 3, vf[lane], mask[lane]);
+      }
+      break;
+    }
+    break;
+  case 0x9:
+    ACE_EACH_LANE
+    for (size_t lane = 0; lane < width; lane += 1) {
+      pc[lane] += mask[lane] & (vx[lane] != vy[lane] ? 2 : 0);
+    }
+    break;
+  case 0xa:
+    ACE_EACH_LANE
+    for (size_t lane = 0; lane < width; lane += 1) {
+      i[lane] = blend16(nnn, i[lane], mask[lane]);
+    }
+    break;
+  case 0xb: {
+    const uint8_t *v0 = column(0);
+    ACE_EACH_LANE
+    for (size_t lane = 0; lane < width; lane += 1) {
+      pc[lane] = blend16(nnn + v0[lane], pc[lane], mask[lane]);
+    }
+    break;
+  }
+  case 0xc: {
+    uint32_t *s0 = &rng[0];
+    uint32_t *s1 = &rng[stride];
+    uint32_t *s2 = &rng[2 * stride];
+    uint32_t *s3 = &rng[3 * stride];
+    ACE_EACH_LANE
+    for (size_t lane = 0; lane < width; lane += 1) {
+      uint32_t a = s0[lane];
+      uint32_t b = s1[lane];
+      uint32_t c = s2[lane];
+      uint32_t d = s3[lane];
+      uint32_t result = rotl(b * 5, 7) * 9;
+      uint32_t t = b << 9;
+      c ^= a;
+      d ^= b;
+      b ^= c;
+      a ^= d;
+      c ^= t;
+      d = rotl(d, 11);
+      s0[lane] = blend32(a, s0[lane], mask[lane]);
+      s1[lane] = blend32(b, s1[lane], mask[lane]);
+      s2[lane] = blend32(c, s2[lane], mask[lane]);
+      s3[lane] = blend32(d, s3[lane], mask[lane]);
+      vx[lane] = blend((result >> 24) & nn, vx[lane], mask[lane]);
+    }
+    break;
+  }
+  case 0xd:
+    for (size_t lane = 0; lane < count; lane += 1) {
+      if (mask[lane]) {
+        draw_sprite(lane, vx[lane], vy[lane], n);
+      }
+    }
+    break;
+  case 0xe:
+    if (nn == 0x9e || nn == 0xa1) {
+      uint16_t want = nn == 0x9e ? 1 : 0;
+      ACE_EACH_LANE
+      for (size_t lane = 0; lane < width; lane += 1) {
+        uint16_t pressed = (kbd[lane] >> (vx[lane] & 0xf)) & 1;
+        pc[lane] += mask[lane] & (pressed == want ? 2 : 0);
+      }
+    }
+    break;
+  case 0xf:
+    switch (nn) {
+    case 0x07:
+      ACE_EACH_LANE
+      for (size_t lane = 0; lane < width; lane += 1) {
+        vx[lane] = blend(dt[lane], vx[lane], mask[lane]);
+      }
+      break;
+    case 0x0a:
+      // lanes without a released key stay put and sit out the frame
+      for (size_t lane = 0; lane < count; lane += 1) {
+        if (!mask[lane]) {
+          continue;
+        }
+        if (key_released[lane]) {
+          int key = 0;
+          while (!((key_released[lane] >> key) & 1)) {
+            key += 1;
+          }
+          vx[lane] = key;
+        } else {
+          pc[lane] -= 2;
+          remaining[lane] = 0;
+        }
+      }
+      break;
+    case 0x15:
+      ACE_EACH_LANE
+      for (size_t lane = 0; lane < width; lane += 1) {
+        dt[lane] = blend(vx[lane], dt[lane], mask[lane]);
+      }
+      break;
+    case 0x18:
+      ACE_EACH_LANE
+      for (size_t lane = 0; lane < width; lane += 1) {
+        st[lane] = blend(vx[lane], st[lane], mask[lane]);
+      }
+      break;
+    case 0x1e:
+      ACE_EACH_LANE
+      for (size_t lane = 0; lane < width; lane += 1) {
+        i[lane] = blend16(i[lane] + vx[lane], i[lane], mask[lane]);
+      }
+      break;
+    case 0x29:
+      // reads the font table, as in Interpreter::get_font_sprite_addr
+      for (size_t lane = 0; lane < count; lane += 1) {
+        if (mask[lane]) {
+          i[lane] = lane_mem(lane)[kFontStartIndex + vx[lane] * 5];
+        }
+      }
+      break;
+    case 0x33:
+      for (size_t lane = 0; lane < count; lane += 1) {
+        if (mask[lane]) {
+          uint8_t val = vx[lane];
+          write_memory(lane, i[lane], val / 100);
+          write_memory(lane, i[lane] + 1, (val / 10) % 10);
+          write_memory(lane, i[lane] + 2, val % 10);
+        }
+      }
+      break;
+    case 0x55:
+      for (size_t lane = 0; lane < count; lane += 1) {
+        if (mask[lane]) {
+          for (int xn = 0; xn <= x; xn += 1) {
+            write_memory(lane, i[lane], v[xn * stride + lane]);
+            // classic chip-8 quirk:
+            i[lane] += 1;
+          }
+        }
+      }
+      break;
+    case 0x65:
+      for (size_t lane = 0; lane < count; lane += 1) {
+        if (mask[lane]) {
+          const uint8_t *m = lane_mem(lane);
+          for (int xn = 0; xn <= x; xn += 1) {
+            v[xn * stride + lane] = m[i[lane] & kAddrMask];
+            // classic chip-8 quirk:
+            i[lane] += 1;
+          }
+        }
+      }
+      break;
+    }
+    break;
+  }
+}
+
+uint16_t LockstepEngine::fetch(size_t lane, uint16_t addr) const {
+  const uint8_t *m = lane_mem(lane);
+  return (m[addr & kAddrMask] << 8) | m[(addr + 1) & kAddrMask];
+}
+
+uint8_t *LockstepEngine::lane_mem(size_t lane) {
+  return &mem[lane * kMemSize];
+}
+
+const uint8_t *LockstepEngine::lane_mem(size_t lane) const {
+  return &mem[lane * kMemSize];
+}
+
+void LockstepEngine::write_memory(size_t lane, uint16_t addr, uint8_t val) {
+  addr &= kAddrMask;
+  lane_mem(lane)[addr] = val;
+  written.set(addr);
+}
+
+void LockstepEngine::stack_push(size_t lane, uint16_t val) {
+  uint8_t *m = lane_mem(lane);
+  uint16_t addr = kStackStartIndex + m[kStackPtrIndex] * 2;
+  // native byte order, like the stack Interpreter keeps in guest memory
+  std::memcpy(&m[addr], &val, sizeof(val));
+  written.set(addr);
+  written.set(addr + 1);
+  write_memory(lane, kStackPtrIndex, m[kStackPtrIndex] + 1);
+}
+
+uint16_t LockstepEngine::stack_pop(size_t lane) {
+  uint8_t *m = lane_mem(lane);
+  write_memory(lane, kStackPtrIndex, m[kStackPtrIndex] - 1);
+  uint16_t val;
+  std::memcpy(&val, &m[kStackStartIndex + m[kStackPtrIndex] * 2], sizeof(val));
+  return val;
+}
+
+void LockstepEngine::draw_sprite(size_t lane, int x, int y, int n) {
+  x = x % kScreenWidth;
+  y = y % kScreenHeight;
+
+  uint8_t &flag = v[0xf * stride + lane];
+  flag = 0;
+
+  // sprite rows land one pixel right of x, see Interpreter::screen_draw_sprite
+  int shift = x + 1;
+  if (shift >= kScreenWidth) {
+    return;
+  }
+
+  const uint8_t *m = lane_mem(lane);
+  screen_row *rows = &screen[lane * kScreenHeight];
+  for (int j = 0; j < n; j += 1) {
+    int sy = y + j;
+    if (sy >= kScreenHeight) {
+      break;
+    }
+
+    screen_row sprite = screen_row{m[(i[lane] + j) & kAddrMask]}
+                        << (kScreenWidth - 8);
+    screen_row bits = sprite >> shift;
+    if (rows[sy] & bits) {
+      flag = 1;
+    }
+    rows[sy] ^= bits;
+  }
+}
+
+uint8_t *LockstepEngine::column(int reg) { return &v[reg * stride]; }
+
+tl::expected<void, std::string>
+verify_lockstep(const std::vector<uint8_t> &rom, size_t lanes,
+                uint32_t first_seed, int frames, int play_rate) {
+  LockstepEngine engine(lanes);
+  engine.update_play_rate = play_rate;
+  engine.set_input_callback([&engine](uint64_t cycle) {
+    for (size_t lane = 0; lane < engine.lanes(); lane += 1) {
+      engine.set_keys(lane, verify_keys(lane, cycle));
+    }
+  });
+  engine.reset(first_seed);
+  engine.load_rom_bytes(rom);
+
+  std::vector<std::shared_ptr<registers>> reference_regs;
+  std::vector<std::unique_ptr<Interpreter>> reference;
+  for (size_t lane = 0; lane < lanes; lane += 1) {
+    auto regs = std::make_shared<registers>();
+    auto interpreter = std::make_unique<Interpreter>(regs);
+    interpreter->update_play_rate = play_rate;
+    interpreter->set_seed(first_seed + static_cast<uint32_t>(lane));
+    interpreter->set_input_callback([regs, lane](uint64_t cycle) {
+      uint16_t keys = verify_keys(lane, cycle);
+      for (int key = 0; key < kKeyboardSize; key += 1) {
+        regs->kbd[key] = (keys >> key) & 1;
+      }
+    });
+    interpreter->initialize();
+    interpreter->load_rom_bytes(rom);
+    reference_regs.push_back(regs);
+    reference.push_back(std::move(interpreter));
+  }
+
+  registers lane_regs;
+  interpreter_state state;
+  for (int frame = 0; frame < frames; frame += 1) {
+    engine.run_frames(1);
+    for (size_t lane = 0; lane < lanes; lane += 1) {
+      reference[lane]->run_frames(1);
+      engine.get_registers(lane, lane_regs);
+      reference[lane]->save_state(state);
+
+      const registers &expected = *reference_regs[lane];
+      if (hash_machine_state(lane_regs) != hash_machine_state(expected) ||
+          engine.get_rng_state(lane) != state.rng) {
+        return tl::unexpected(fmt::format(
+            "lane {} differs after frame {}: pc {:03x}/{:03x} i {:03x}/{:03x}",
+            lane, frame + 1, lane_regs.pc, expected.pc, lane_regs.i,
+            expected.i));
+      }
+    }
+  }
+
+  const lockstep_stats &stats = engine.get_stats();
+  spdlog::info("Lockstep matches the interpreter on {} lanes over {} frames, "
+               "{} of {} groups divergent",
+               lanes, frames, stats.divergent_groups, stats.groups);
+  return {};
+}
@@ -0,0 +1,123 @@
+#pragma once
+
+#include "interpreter.h"
+#include "random.h"
+#include "registers.h"
+
+#include <bitset>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <tl/expected.hpp>
+#include <vector>
+
+// lane columns are padded to this many entries so kernels run whole vectors
+constexpr size_t kLockstepLaneAlign = 32;
+
+struct lockstep_stats {
+  uint64_t frames = 0;
+  // instructions summed over every lane
+  uint64_t instructions = 0;
+  // fetches, each running one instruction on a group of lanes
+  uint64_t groups = 0;
+  // groups run while the lanes were split up
+  uint64_t divergent_groups = 0;
+};
+
+// Many machines running the same ROM, stored column-wise: register VX of
+// every lane sits in one array, as do PC, I, the timers and the RNG state.
+// Lanes at the same PC run each instruction together as a loop over those
+// columns, with a byte mask per lane selecting who takes part.
+//
+// While every lane is at the same PC with the same instructions left in the
+// frame the engine is converged and tracks a single PC. A branch that splits
+// the lanes puts each on its own PC; from then on the lowest PC runs first,
+// which lets the lanes behind catch up and merge again.
+//
+// Interpreter is the reference, verify_lockstep() checks the two agree.
+class LockstepEngine {
+public:
+  explicit LockstepEngine(size_t lanes);
+
+  size_t lanes() const;
+
+  int update_play_rate = kDefaultPlayingUpdateRate;
+
+  // powers on every lane, lane n seeded with first_seed + n
+  void reset(uint32_t first_seed);
+  void load_rom_bytes(const std::vector<uint8_t> &bytes);
+  void run_frames(int count);
+
+  // keypad of one lane as a bitmask, key n in bit n
+  void set_keys(size_t lane, uint16_t keys);
+  // called at every frame boundary before the keypads are sampled
+  void set_input_callback(std::function<void(uint64_t cycle)> callback);
+
+  uint64_t get_cycle() const;
+  const lockstep_stats &get_stats() const;
+
+  // copies one lane out in the layout the rest of the emulator uses
+  void get_registers(size_t lane, registers &out) const;
+  Random::state_type get_rng_state(size_t lane) const;
+
+private:
+  void begin_frame();
+  void end_frame();
+  void run_frame();
+  void run_converged();
+  bool run_divergent_group();
+
+  void execute(uint16_t instr, const uint8_t *mask);
+  void diverge();
+  void try_converge();
+
+  uint16_t fetch(size_t lane, uint16_t addr) const;
+  uint8_t *lane_mem(size_t lane);
+  const uint8_t *lane_mem(size_t lane) const;
+  void write_memory(size_t lane, uint16_t addr, uint8_t val);
+  void stack_push(size_t lane, uint16_t val);
+  uint16_t stack_pop(size_t lane);
+  void draw_sprite(size_t lane, int x, int y, int n);
+  uint8_t *column(int reg);
+
+  size_t count;
+  size_t stride;
+
+  std::vector<uint8_t> v;
+  std::vector<uint16_t> pc;
+  std::vector<uint16_t> i;
+  std::vector<uint8_t> dt;
+  std::vector<uint8_t> st;
+  // xoshiro128** state, four columns
+  std::vector<uint32_t> rng;
+  std::vector<uint16_t> kbd;
+  std::vector<uint16_t> key_down;
+  std::vector<uint16_t> key_released;
+  std::vector<int32_t> remaining;
+  // one machine after another
+  std::vector<uint8_t> mem;
+  std::vector<screen_row> screen;
+
+  std::vector<uint8_t> group;
+  std::vector<uint8_t> all_lanes;
+  // addresses any lane stored to, only there can the lanes' code differ
+  std::bitset<kMemSize> written;
+
+  bool converged = true;
+  uint16_t shared_pc = 0;
+  int shared_remaining = 0;
+
+  int frame_quota = 0;
+  int frame_remainder = 0;
+  uint64_t cycles = 0;
+
+  std::function<void(uint64_t cycle)> input_callback;
+  lockstep_stats stats;
+};
+
+// Runs the engine next to one Interpreter per lane, with the same seeds and
+// pseudo-random keypad input, and compares every lane after every frame.
+tl::expected<void, std::string>
+verify_lockstep(const std::vector<uint8_t> &rom, size_t lanes,
+                uint32_t first_seed, int frames, int play_rate);
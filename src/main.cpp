@@ -1,9 +1,15 @@
+#include "batch.h"
+#include "emulator.h"
+#include "hash.h"
+#include "headless.h"
 #include "interface.h"
 #include "interpreter.h"
-#include "registers.h"
+#include "lockstep.h"
+#include "timer.h"
 
 #include <argparse/argparse.hpp>
 #include <magic_enum.hpp>
+#include <spdlog/sinks/stdout_color_sinks.h>
 #include <spdlog/spdlog.h>
 
 static bool set_logging_level(const std::string &level_name) {
@@ -15,6 +21,203 @@ static bool set_logging_level(const std::string &level_name) {
   return false;
 }
 
+static std::optional<backend_type> parse_backend(const std::string &name) {
+  return magic_enum::enum_cast<backend_type>(name);
+}
+
+static int run_headless_mode(argparse::ArgumentParser &program,
+                             backend_type backend) {
+  // stdout carries the results, keep the log out of it
+  auto level = spdlog::get_level();
+  spdlog::set_default_logger(spdlog::stderr_color_mt("headless"));
+  spdlog::set_level(level);
+
+  headless_options options;
+  options.backend = backend;
+  options.seed = program.present<uint32_t>("--seed");
+  options.play_rate = program.get<int>("--play-rate");
+  options.frames = program.get<uint64_t>("--frames");
+  options.instructions = program.get<uint64_t>("--instructions");
+  if (auto movies = program.present<std::vector<std::string>>("--movie")) {
+    options.movie_path = movies->front();
+  }
+  if (auto roms = program.present<std::vector<std::string>>("--rom")) {
+    options.rom_path = roms->front();
+  } else {
+    spdlog::error("--headless needs a ROM, pass one with --rom");
+    return 1;
+  }
+
+  registers regs;
+  auto result = run_headless(options, regs);
+  if (!result) {
+    spdlog::error("Headless run failed: {}", result.error());
+    return 1;
+  }
+
+  if (auto path = program.present("--dump-screen")) {
+    if (auto written = write_screen_image(regs, path.value()); !written) {
+      spdlog::error("Failed to dump screen: {}", written.error());
+      return 1;
+    }
+  }
+
+  if (program.get<bool>("--hash")) {
+    fmt::print("state hash: {:016x}\n", result->state_hash);
+  }
+
+  if (program.get<bool>("--stats")) {
+    double ips =
+        result->seconds > 0 ? result->instructions / result->seconds : 0;
+    fmt::print("seed: {}\n", result->seed);
+    fmt::print("frames: {}\n", result->frames);
+    fmt::print("instructions: {}\n", result->instructions);
+    fmt::print("guest cycles: {}\n", result->cycles);
+    fmt::print("wall time: {:.3f} s\n", result->seconds);
+    fmt::print("instructions per second: {:.0f}\n", ips);
+  }
+
+  return 0;
+}
+
+static int run_lockstep_mode(argparse::ArgumentParser &program) {
+  auto level = spdlog::get_level();
+  spdlog::set_default_logger(spdlog::stderr_color_mt("lockstep"));
+  spdlog::set_level(level);
+
+  auto roms = program.present<std::vector<std::string>>("--rom");
+  if (!roms) {
+    spdlog::error("--lockstep needs a ROM, pass one with --rom");
+    return 1;
+  }
+  auto rom = read_rom(roms->front());
+  if (!rom) {
+    spdlog::error("Failed to read ROM: {}", rom.error());
+    return 1;
+  }
+
+  int lanes = program.get<int>("--lockstep");
+  uint64_t frames = program.get<uint64_t>("--frames");
+  if (lanes <= 0 || frames == 0) {
+    spdlog::error("--lockstep needs a lane count and --frames");
+    return 1;
+  }
+  int play_rate = std::max(program.get<int>("--play-rate"), 1);
+  uint32_t first_seed =
+      program.present<uint32_t>("--seed").value_or(make_random_seed());
+
+  if (program.get<bool>("--verify-lockstep")) {
+    auto verified = verify_lockstep(rom.value(), lanes, first_seed,
+                                    static_cast<int>(frames), play_rate);
+    if (!verified) {
+      spdlog::error("Lockstep check failed: {}", verified.error());
+      return 1;
+    }
+    fmt::print("lockstep matches the interpreter on {} lanes\n", lanes);
+    return 0;
+  }
+
+  LockstepEngine engine(lanes);
+  engine.update_play_rate = play_rate;
+  engine.reset(first_seed);
+  engine.load_rom_bytes(rom.value());
+
+  Timer timer;
+  engine.run_frames(static_cast<int>(frames));
+  double seconds = timer.duration();
+
+  if (program.get<bool>("--hash")) {
+    // one hash over every lane in order
+    uint64_t hash = kHashOffsetBasis;
+    registers regs;
+    for (int lane = 0; lane < lanes; lane += 1) {
+      engine.get_registers(lane, regs);
+      uint64_t lane_hash = hash_machine_state(regs);
+      hash = hash_bytes(&lane_hash, sizeof(lane_hash), hash);
+    }
+    fmt::print("state hash: {:016x}\n", hash);
+  }
+
+  if (program.get<bool>("--stats")) {
+    const lockstep_stats &stats = engine.get_stats();
+    double ips = seconds > 0 ? stats.instructions / seconds : 0;
+    fmt::print("lanes: {}\n", lanes);
+    fmt::print("first seed: {}\n", first_seed);
+    fmt::print("frames: {}\n", stats.frames);
+    fmt::print("instructions: {}\n", stats.instructions);
+    fmt::print("groups: {} ({} divergent)\n", stats.groups,
+               stats.divergent_groups);
+    fmt::print("wall time: {:.3f} s\n", seconds);
+    fmt::print("instructions per second: {:.0f}\n", ips);
+  }
+
+  return 0;
+}
+
+static int run_batch_mode(argparse::ArgumentParser &program,
+                          backend_type backend) {
+  auto level = spdlog::get_level();
+  spdlog::set_default_logger(spdlog::stderr_color_mt("batch"));
+  spdlog::set_level(level);
+
+  headless_options base;
+  base.backend = backend;
+  base.seed = program.present<uint32_t>("--seed");
+  base.play_rate = program.get<int>("--play-rate");
+  base.frames = program.get<uint64_t>("--frames");
+  base.instructions = program.get<uint64_t>("--instructions");
+
+  auto roms = program.present<std::vector<std::string>>("--rom");
+  auto movies = program.present<std::vector<std::string>>("--movie");
+  if (!roms) {
+    spdlog::error("--batch needs ROMs, pass files or directories with --rom");
+    return 1;
+  }
+
+  auto jobs = make_batch_jobs(
+      roms.value(), movies.value_or(std::vector<std::string>{}),
+      std::max(program.get<int>("--seeds"), 1), base);
+  if (!jobs) {
+    spdlog::error("Failed to set up batch: {}", jobs.error());
+    return 1;
+  }
+  if (jobs->empty()) {
+    spdlog::error("Nothing to run, give --frames, --instructions or --movie");
+    return 1;
+  }
+
+  Timer timer;
+  auto threads =
+      static_cast<unsigned>(std::max(program.get<int>("--threads"), 0));
+  std::vector<batch_result> results = run_batch(jobs.value(), threads);
+  double seconds = timer.duration();
+
+  uint64_t instructions = 0;
+  size_t failed = 0;
+  for (const batch_result &entry : results) {
+    if (entry.result) {
+      instructions += entry.result->instructions;
+    } else {
+      failed += 1;
+    }
+  }
+  spdlog::info(
+      "Ran {} jobs in {:.3f} s, {:.0f} instructions per second, {} failed",
+      results.size(), seconds, seconds > 0 ? instructions / seconds : 0,
+      failed);
+
+  if (auto path = program.present("--summary")) {
+    if (auto written = write_batch_summary(results, path.value()); !written) {
+      spdlog::error("Failed to write summary: {}", written.error());
+      return 1;
+    }
+  } else {
+    fmt::print("{}", format_batch_csv(results));
+  }
+
+  return failed > 0 ? 1 : 0;
+}
+
 auto main(int argc, char *argv[]) -> int {
   spdlog::set_level(spdlog::level::info);
 
@@ -25,6 +228,98 @@ auto main(int argc, char *argv[]) -> int {
       .default_value(std::string("info"))
       .nargs(1);
 
+  program.add_argument("--backend")
+      .help("Select the emulation backend")
+      .default_value(std::string("interpreter"))
+      .nargs(1);
+
+  program.add_argument("--seed")
+      .help("Seed the random number generator for reproducible runs")
+      .scan<'u', uint32_t>()
+      .nargs(1);
+
+  program.add_argument("--headless")
+      .help("Run without a window, audio or UI and exit when done")
+      .default_value(false)
+      .implicit_value(true);
+
+  program.add_argument("--batch")
+      .help("Run every ROM, seed and movie given on all cores and summarize")
+      .default_value(false)
+      .implicit_value(true);
+
+  program.add_argument("--rom")
+      .help("ROM to run in headless mode, files or directories in batch mode")
+      .nargs(argparse::nargs_pattern::at_least_one);
+
+  program.add_argument("--frames")
+      .help("Guest frames to run in headless mode")
+      .default_value(uint64_t{0})
+      .scan<'u', uint64_t>()
+      .nargs(1);
+
+  program.add_argument("--instructions")
+      .help("Instructions to run in headless mode, used without --frames")
+      .default_value(uint64_t{0})
+      .scan<'u', uint64_t>()
+      .nargs(1);
+
+  program.add_argument("--play-rate")
+      .help("Instructions per second of guest time in headless mode")
+      .default_value(kDefaultPlayingUpdateRate)
+      .scan<'i', int>()
+      .nargs(1);
+
+  program.add_argument("--movie")
+      .help("Replay a movie in headless mode, runs to its end by default")
+      .nargs(argparse::nargs_pattern::at_least_one);
+
+  program.add_argument("--seeds")
+      .help("Runs of every ROM in batch mode, with consecutive seeds")
+      .default_value(1)
+      .scan<'i', int>()
+      .nargs(1);
+
+  program.add_argument("--threads")
+      .help("Worker threads in batch mode, 0 for one per core")
+      .default_value(0)
+      .scan<'i', int>()
+      .nargs(1);
+
+  program.add_argument("--summary")
+      .help("Write the batch summary to a .csv or .json file instead of stdout")
+      .nargs(1);
+
+  program.add_argument("--lockstep")
+      .help("Run this many copies of the ROM in lockstep, implies --headless")
+      .default_value(0)
+      .scan<'i', int>()
+      .nargs(1);
+
+  program.add_argument("--verify-lockstep")
+      .help("Check the lockstep engine against the interpreter and exit")
+      .default_value(false)
+      .implicit_value(true);
+
+  program.add_argument("--shared-memory")
+      .help("Publish the machine to this POSIX shared memory segment and "
+            "take keypad input from it")
+      .nargs(1);
+
+  program.add_argument("--dump-screen")
+      .help("Write the final framebuffer to a .pbm or .png file")
+      .nargs(1);
+
+  program.add_argument("--hash")
+      .help("Print a hash of the final machine state")
+      .default_value(false)
+      .implicit_value(true);
+
+  program.add_argument("--stats")
+      .help("Print frames, instructions and throughput of a headless run")
+      .default_value(false)
+      .implicit_value(true);
+
   try {
     program.parse_args(argc, argv);
   } catch (const std::exception &err) {
@@ -43,20 +338,67 @@ auto main(int argc, char *argv[]) -> int {
     return 1;
   }
 
-  auto regs = std::make_shared<registers>();
+  const std::string backend_name = program.get("--backend");
+  auto backend = parse_backend(backend_name);
+  if (!backend.has_value()) {
+    std::cerr << fmt::format("Invalid argument \"{}\" - allowed options: "
+                             "{{interpreter, recompiler}}",
+                             backend_name)
+              << std::endl;
+    std::cerr << program;
+    return 1;
+  }
 
-  Interpreter interpreter(regs);
-  Interface interface(regs, &interpreter);
+  int lockstep_lanes = program.get<int>("--lockstep");
+  if (program.get<bool>("--verify-lockstep") && lockstep_lanes <= 0) {
+    std::cerr << "--verify-lockstep needs a lane count, pass one with "
+                 "--lockstep"
+              << std::endl;
+    std::cerr << program;
+    return 1;
+  }
+  if (program.get<bool>("--batch") && lockstep_lanes > 0) {
+    std::cerr << "--lockstep runs one ROM, it can't be combined with --batch"
+              << std::endl;
+    std::cerr << program;
+    return 1;
+  }
+
+  if (program.get<bool>("--batch")) {
+    return run_batch_mode(program, backend.value());
+  }
+
+  if (lockstep_lanes > 0) {
+    return run_lockstep_mode(program);
+  }
+
+  if (program.get<bool>("--headless")) {
+    return run_headless_mode(program, backend.value());
+  }
+
+  Emulator emulator;
+  emulator.send({emulator_command_type::set_backend, 0,
+                 static_cast<int>(backend.value())});
+  Interface interface(&emulator);
 
   interface.initialize();
-  interpreter.initialize();
+  // overrides the seed from the settings file
+  if (auto seed = program.present<uint32_t>("--seed")) {
+    emulator.send({emulator_command_type::set_seed, 1,
+                   static_cast<int>(seed.value())});
+  }
+  if (auto name = program.present("--shared-memory")) {
+    emulator_command command{emulator_command_type::share_state};
+    command.path = name.value();
+    emulator.send(std::move(command));
+  }
+  emulator.initialize();
 
-  do {
-    interpreter.update();
-  } while (!interface.update());
+  while (!interface.update()) {
+  }
 
+  emulator.cleanup();
   interface.cleanup();
-  interpreter.cleanup();
 
   spdlog::info("Exiting.");
 
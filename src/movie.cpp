@@ -0,0 +1,188 @@
+#include "movie.h"
+
+#include <fstream>
+#include <iterator>
+#include <spdlog/spdlog.h>
+
+namespace {
+
+class Writer {
+public:
+  std::vector<uint8_t> bytes;
+
+  void u32(uint32_t val) {
+    for (int shift = 0; shift < 32; shift += 8) {
+      bytes.push_back((val >> shift) & 0xff);
+    }
+  }
+
+  void u64(uint64_t val) {
+    u32(val & 0xffffffff);
+    u32(val >> 32);
+  }
+
+  void varint(uint64_t val) {
+    while (val >= 0x80) {
+      bytes.push_back((val & 0x7f) | 0x80);
+      val >>= 7;
+    }
+    bytes.push_back(val);
+  }
+};
+
+class Reader {
+public:
+  explicit Reader(const std::vector<uint8_t> &bytes) : bytes(bytes) {}
+
+  bool ok() const { return !overrun; }
+
+  uint8_t u8() {
+    if (pos >= bytes.size()) {
+      overrun = true;
+      return 0;
+    }
+    return bytes[pos++];
+  }
+
+  uint32_t u32() {
+    uint32_t val = 0;
+    for (int shift = 0; shift < 32; shift += 8) {
+      val |= static_cast<uint32_t>(u8()) << shift;
+    }
+    return val;
+  }
+
+  uint64_t u64() {
+    uint64_t lo = u32();
+    return lo | (static_cast<uint64_t>(u32()) << 32);
+  }
+
+  uint64_t varint() {
+    uint64_t val = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+      uint8_t byte = u8();
+      val |= static_cast<uint64_t>(byte & 0x7f) << shift;
+      if (!(byte & 0x80)) {
+        return val;
+      }
+    }
+    overrun = true;
+    return val;
+  }
+
+private:
+  const std::vector<uint8_t> &bytes;
+  size_t pos = 0;
+  bool overrun = false;
+};
+
+} // namespace
+
+tl::expected<void, std::string> movie::save(const std::string &filename) const {
+  Writer out;
+  out.u32(kMovieMagic);
+  out.u32(kMovieVersion);
+  out.u32(seed);
+  out.u32(play_rate);
+  out.u64(rom_hash);
+  out.u64(end_cycle);
+  out.u32(events.size());
+
+  uint64_t cycle = 0;
+  for (const movie_event &event : events) {
+    out.varint(event.cycle - cycle);
+    out.bytes.push_back((event.key & (kKeyboardSize - 1)) | (event.down << 4));
+    cycle = event.cycle;
+  }
+
+  std::ofstream file(filename, std::ios::binary);
+  file.write(reinterpret_cast<const char *>(out.bytes.data()), out.bytes.size());
+  if (!file) {
+    return tl::unexpected(fmt::format("failed to write {}", filename));
+  }
+  return {};
+}
+
+tl::expected<movie, std::string> movie::load(const std::string &filename) {
+  std::ifstream file(filename, std::ios::binary);
+  if (!file) {
+    return tl::unexpected(fmt::format("failed to open {}", filename));
+  }
+  std::vector<uint8_t> bytes = {std::istreambuf_iterator<char>(file), {}};
+
+  Reader in(bytes);
+  if (in.u32() != kMovieMagic) {
+    return tl::unexpected(std::string("not a movie file"));
+  }
+  if (uint32_t version = in.u32(); version != kMovieVersion) {
+    return tl::unexpected(fmt::format("unsupported movie version {}", version));
+  }
+
+  movie result;
+  result.seed = in.u32();
+  result.play_rate = static_cast<int>(in.u32());
+  result.rom_hash = in.u64();
+  result.end_cycle = in.u64();
+
+  uint32_t count = in.u32();
+  uint64_t cycle = 0;
+  for (uint32_t idx = 0; idx < count && in.ok(); idx += 1) {
+    cycle += in.varint();
+    uint8_t packed = in.u8();
+    result.events.push_back({cycle, static_cast<uint8_t>(packed & 0xf),
+                             (packed & 0x10) != 0});
+  }
+
+  if (!in.ok()) {
+    return tl::unexpected(std::string("movie file is truncated"));
+  }
+  return result;
+}
+
+void MovieRecorder::start(uint32_t seed, int play_rate, uint64_t rom_hash) {
+  recording = {};
+  recording.seed = seed;
+  recording.play_rate = play_rate;
+  recording.rom_hash = rom_hash;
+  latched.fill(false);
+}
+
+movie &MovieRecorder::finish(uint64_t end_cycle) {
+  recording.end_cycle = end_cycle;
+  return recording;
+}
+
+void MovieRecorder::set_key(int key, bool down) {
+  latched[key & (kKeyboardSize - 1)] = down;
+}
+
+void MovieRecorder::apply(uint64_t cycle,
+                          std::array<bool, kKeyboardSize> &kbd) {
+  for (int key = 0; key < kKeyboardSize; key += 1) {
+    if (kbd[key] != latched[key]) {
+      kbd[key] = latched[key];
+      recording.events.push_back(
+          {cycle, static_cast<uint8_t>(key), latched[key]});
+    }
+  }
+}
+
+void MoviePlayer::start(movie movie_) {
+  replay = std::move(movie_);
+  next_event = 0;
+}
+
+void MoviePlayer::apply(uint64_t cycle, std::array<bool, kKeyboardSize> &kbd) {
+  while (next_event < replay.events.size() &&
+         replay.events[next_event].cycle <= cycle) {
+    const movie_event &event = replay.events[next_event];
+    kbd[event.key] = event.down;
+    next_event += 1;
+  }
+}
+
+bool MoviePlayer::is_finished(uint64_t cycle) const {
+  return next_event == replay.events.size() && cycle >= replay.end_cycle;
+}
+
+const movie &MoviePlayer::get_movie() const { return replay; }
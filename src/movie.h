@@ -0,0 +1,74 @@
+#pragma once
+
+#include "registers.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <tl/expected.hpp>
+#include <vector>
+
+// "ACEM" read as a little-endian word
+constexpr uint32_t kMovieMagic = 0x4d454341;
+constexpr uint32_t kMovieVersion = 1;
+
+enum class movie_mode {
+  none,
+  recording,
+  replaying,
+};
+
+// A keypad transition, taking effect at the frame boundary at cycle.
+struct movie_event {
+  uint64_t cycle = 0;
+  uint8_t key = 0;
+  bool down = false;
+};
+
+// Everything needed to reproduce a run from power-on: the RNG seed, the
+// instruction rate that sets the frame length, and every keypad change in
+// guest time. Events are stored as varint cycle deltas with the key and its
+// state packed into one byte.
+struct movie {
+  uint32_t seed = 0;
+  int play_rate = 0;
+  uint64_t rom_hash = 0;
+  // cycle the recording stopped at
+  uint64_t end_cycle = 0;
+  std::vector<movie_event> events;
+
+  tl::expected<void, std::string> save(const std::string &filename) const;
+  static tl::expected<movie, std::string> load(const std::string &filename);
+};
+
+// Records keypad changes while a movie is active. Input is latched and only
+// reaches the machine at frame boundaries, the only points a replay can hit
+// exactly without stopping the interpreter mid-frame.
+class MovieRecorder {
+public:
+  void start(uint32_t seed, int play_rate, uint64_t rom_hash);
+  movie &finish(uint64_t end_cycle);
+
+  void set_key(int key, bool down);
+  // called at each frame boundary before the keypad is sampled
+  void apply(uint64_t cycle, std::array<bool, kKeyboardSize> &kbd);
+
+private:
+  movie recording;
+  std::array<bool, kKeyboardSize> latched{false};
+};
+
+// Feeds a movie back into the keypad. Depends on nothing but guest time, so
+// it drives the emulation thread and a headless run alike.
+class MoviePlayer {
+public:
+  void start(movie replay);
+
+  void apply(uint64_t cycle, std::array<bool, kKeyboardSize> &kbd);
+  bool is_finished(uint64_t cycle) const;
+  const movie &get_movie() const;
+
+private:
+  movie replay;
+  size_t next_event = 0;
+};
@@ -0,0 +1,65 @@
+#include "panel_refresh.h"
+
+#include <imgui.h>
+
+PanelRefresh::PanelRefresh(const char *name) : name(name) {}
+
+void PanelRefresh::update(const registers &live, bool playing, double now) {
+  bool refresh = !playing;
+  switch (policy) {
+  case refresh_policy::every_frame:
+    refresh = true;
+    break;
+  case refresh_policy::fixed_rate:
+    refresh = refresh || now - last_refresh >= 1.0 / rate;
+    break;
+  case refresh_policy::on_pause:
+    break;
+  }
+
+  if (refresh) {
+    snapshot = live;
+    last_refresh = now;
+  }
+}
+
+void PanelRefresh::begin_profile() { timer.reset(); }
+
+void PanelRefresh::end_profile() {
+  cost += (timer.duration() - cost) * kProfileSmoothing;
+}
+
+registers *PanelRefresh::get_registers() { return &snapshot; }
+
+const char *PanelRefresh::get_name() const { return name; }
+
+double PanelRefresh::get_cost() const { return cost; }
+
+void PanelRefresh::draw_row(double frame_cost) {
+  ImGui::PushID(name);
+
+  ImGui::TableNextColumn();
+  ImGui::Text("%s", name);
+
+  ImGui::TableNextColumn();
+  const char *policies[] = {"Every frame", "Fixed rate", "On pause"};
+  int current = static_cast<int>(policy);
+  ImGui::SetNextItemWidth(-1);
+  if (ImGui::Combo("##policy", &current, policies, IM_ARRAYSIZE(policies))) {
+    policy = static_cast<refresh_policy>(current);
+  }
+
+  ImGui::TableNextColumn();
+  if (policy == refresh_policy::fixed_rate) {
+    ImGui::SetNextItemWidth(-1);
+    ImGui::SliderInt("##rate", &rate, 1, 60, "%d Hz");
+  }
+
+  ImGui::TableNextColumn();
+  ImGui::Text("%.3f ms", cost * 1000.0);
+
+  ImGui::TableNextColumn();
+  ImGui::Text("%.1f%%", frame_cost > 0 ? 100.0 * cost / frame_cost : 0.0);
+
+  ImGui::PopID();
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "registers.h"
+#include "timer.h"
+
+constexpr int kDefaultPanelRefreshRate = 10;
+// weight of the newest sample in the profiler's running averages
+constexpr double kProfileSmoothing = 0.05;
+
+enum class refresh_policy {
+  every_frame,
+  fixed_rate,
+  on_pause,
+};
+
+// Decides when a debug panel refreshes its own copy of the emulator state,
+// and keeps a running average of how long drawing the panel takes.
+class PanelRefresh {
+public:
+  explicit PanelRefresh(const char *name);
+
+  void update(const registers &live, bool playing, double now);
+
+  void begin_profile();
+  void end_profile();
+
+  registers *get_registers();
+  const char *get_name() const;
+  double get_cost() const;
+
+  // draws the policy controls as one row of the profiler table
+  void draw_row(double frame_cost);
+
+private:
+  const char *name;
+  refresh_policy policy = refresh_policy::every_frame;
+  int rate = kDefaultPanelRefreshRate;
+  double last_refresh = 0;
+  registers snapshot;
+
+  Timer timer;
+  double cost = 0;
+};
@@ -1,9 +1,50 @@
 #include "random.h"
 #include <random>
 
-uint8_t random_byte() {
-  static std::random_device rd;
-  static std::mt19937 gen(rd());
-  static std::uniform_int_distribution<> dist(0, 255);
-  return dist(gen);
+namespace {
+
+inline uint32_t rotl(uint32_t x, int k) { return (x << k) | (x >> (32 - k)); }
+
+// spreads a seed over the whole state, never leaves it all zero
+uint64_t splitmix64(uint64_t &x) {
+  uint64_t z = (x += 0x9e3779b97f4a7c15);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+  return z ^ (z >> 31);
+}
+
+} // namespace
+
+Random::Random(uint32_t seed_) { seed(seed_); }
+
+void Random::seed(uint32_t seed) {
+  uint64_t x = seed;
+  uint64_t a = splitmix64(x);
+  uint64_t b = splitmix64(x);
+  s = {static_cast<uint32_t>(a), static_cast<uint32_t>(a >> 32),
+       static_cast<uint32_t>(b), static_cast<uint32_t>(b >> 32)};
+}
+
+uint32_t Random::next() {
+  uint32_t result = rotl(s[1] * 5, 7) * 9;
+  uint32_t t = s[1] << 9;
+
+  s[2] ^= s[0];
+  s[3] ^= s[1];
+  s[1] ^= s[2];
+  s[0] ^= s[3];
+  s[2] ^= t;
+  s[3] = rotl(s[3], 11);
+
+  return result;
+}
+
+const Random::state_type &Random::get_state() const { return s; }
+
+void Random::set_state(const state_type &state) { s = state; }
+
+uint32_t make_random_seed() {
+  // only needed once per reset, not worth sharing across threads
+  std::random_device rd;
+  return rd();
 }
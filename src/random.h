@@ -1,5 +1,25 @@
 #pragma once
 
+#include <array>
 #include <cstdint>
 
-uint8_t random_byte();
+// xoshiro128**, small enough to live in every interpreter and save state
+class Random {
+public:
+  using state_type = std::array<uint32_t, 4>;
+
+  explicit Random(uint32_t seed = 0);
+
+  void seed(uint32_t seed);
+  uint32_t next();
+  inline uint8_t next_byte() { return next() >> 24; }
+
+  const state_type &get_state() const;
+  void set_state(const state_type &state);
+
+private:
+  state_type s;
+};
+
+// a fresh seed from the system's entropy source
+uint32_t make_random_seed();
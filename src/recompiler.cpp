@@ -0,0 +1,383 @@
+#include "recompiler.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <spdlog/spdlog.h>
+
+#if defined(__x86_64__) && !defined(_WIN32)
+#define ACE_RECOMPILER_X64 1
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+constexpr int kMaxBlocks = 16384;
+
+// all operands are addressed as [rdi + disp8], rdi holding the registers
+constexpr uint8_t kRegAl = 0;
+constexpr uint8_t kRegCl = 1;
+constexpr uint8_t kRegDl = 2;
+
+constexpr uint8_t kOffsetPc = offsetof(registers, pc);
+constexpr uint8_t kOffsetI = offsetof(registers, i);
+constexpr uint8_t kOffsetDt = offsetof(registers, dt);
+constexpr uint8_t kOffsetSt = offsetof(registers, st);
+constexpr uint8_t kOffsetV = offsetof(registers, v);
+constexpr uint8_t kOffsetVf = kOffsetV + 0xf;
+
+static_assert(offsetof(registers, v) + kGeneralRegisterCount < 0x80,
+              "register file must be addressable with an 8-bit displacement");
+
+class Emitter {
+public:
+  std::vector<uint8_t> code;
+
+  void byte(uint8_t b) { code.push_back(b); }
+
+  void word(uint16_t w) {
+    byte(w & 0xff);
+    byte(w >> 8);
+  }
+
+  // <op> reg, [rdi + disp]  or  <op> [rdi + disp], reg
+  void mem(std::initializer_list<uint8_t> op, uint8_t reg, uint8_t disp) {
+    for (uint8_t b : op) {
+      byte(b);
+    }
+    byte(0x40 | (reg << 3) | 0x7);
+    byte(disp);
+  }
+
+  void load(uint8_t reg, uint8_t disp) { mem({0x8a}, reg, disp); }
+  void store(uint8_t disp, uint8_t reg) { mem({0x88}, reg, disp); }
+  void store_imm(uint8_t disp, uint8_t imm) {
+    mem({0xc6}, 0, disp);
+    byte(imm);
+  }
+  void store_imm16(uint8_t disp, uint16_t imm) {
+    mem({0x66, 0xc7}, 0, disp);
+    word(imm);
+  }
+};
+
+uint8_t vreg(int x) { return kOffsetV + x; }
+
+// Emits the body for one instruction, returns false if it can't be
+// translated and has to end the block.
+bool emit_instruction(Emitter &e, uint16_t instr) {
+  uint8_t x = (instr >> 8) & 0xf;
+  uint8_t y = (instr >> 4) & 0xf;
+  uint8_t nn = instr & 0xff;
+
+  switch (instr >> 12) {
+  case 0x6:
+    // mov byte [vx], nn
+    e.store_imm(vreg(x), nn);
+    return true;
+  case 0x7:
+    // add byte [vx], nn
+    e.mem({0x80}, 0, vreg(x));
+    e.byte(nn);
+    return true;
+  case 0x8:
+    switch (instr & 0xf) {
+    case 0x0:
+      e.load(kRegAl, vreg(y));
+      e.store(vreg(x), kRegAl);
+      return true;
+    case 0x1:
+    case 0x2:
+    case 0x3: {
+      static const uint8_t ops[] = {0, 0x0a, 0x22, 0x32};
+      e.store_imm(kOffsetVf, 0);
+      e.load(kRegAl, vreg(x));
+      e.mem({ops[instr & 0xf]}, kRegAl, vreg(y));
+      e.store(vreg(x), kRegAl);
+      return true;
+    }
+    case 0x4:
+      // movzx eax, [vx]; movzx ecx, [vy]; add eax, ecx
+      e.mem({0x0f, 0xb6}, kRegAl, vreg(x));
+      e.mem({0x0f, 0xb6}, kRegCl, vreg(y));
+      e.byte(0x01);
+      e.byte(0xc8);
+      e.store(vreg(x), kRegAl);
+      // shr eax, 8
+      e.byte(0xc1);
+      e.byte(0xe8);
+      e.byte(0x08);
+      e.store(kOffsetVf, kRegAl);
+      return true;
+    case 0x5:
+      e.load(kRegAl, vreg(x));
+      e.load(kRegCl, vreg(y));
+      // cmp al, cl; setae dl; sub al, cl
+      e.byte(0x38);
+      e.byte(0xc8);
+      e.byte(0x0f);
+      e.byte(0x93);
+      e.byte(0xc2);
+      e.byte(0x28);
+      e.byte(0xc8);
+      e.store(vreg(x), kRegAl);
+      e.store(kOffsetVf, kRegDl);
+      return true;
+    case 0x6:
+      e.load(kRegAl, vreg(y));
+      // mov dl, al; and dl, 1; shr al, 1
+      e.byte(0x88);
+      e.byte(0xc2);
+      e.byte(0x80);
+      e.byte(0xe2);
+      e.byte(0x01);
+      e.byte(0xd0);
+      e.byte(0xe8);
+      e.store(vreg(x), kRegAl);
+      e.store(kOffsetVf, kRegDl);
+      return true;
+    case 0x7:
+      e.load(kRegAl, vreg(y));
+      e.mem({0x2a}, kRegAl, vreg(x));
+      e.store(vreg(x), kRegAl);
+      e.load(kRegAl, vreg(y));
+      e.mem({0x3a}, kRegAl, vreg(x));
+      // setae al
+      e.byte(0x0f);
+      e.byte(0x93);
+      e.byte(0xc0);
+      e.store(kOffsetVf, kRegAl);
+      return true;
+    case 0xe:
+      e.load(kRegAl, vreg(y));
+      // mov dl, al; shr dl, 3; and dl, 1; shl al, 1
+      e.byte(0x88);
+      e.byte(0xc2);
+      e.byte(0xc0);
+      e.byte(0xea);
+      e.byte(0x03);
+      e.byte(0x80);
+      e.byte(0xe2);
+      e.byte(0x01);
+      e.byte(0xd0);
+      e.byte(0xe0);
+      e.store(vreg(x), kRegAl);
+      e.store(kOffsetVf, kRegDl);
+      return true;
+    }
+    return false;
+  case 0xa:
+    e.store_imm16(kOffsetI, instr & 0xfff);
+    return true;
+  case 0xf:
+    switch (nn) {
+    case 0x07:
+      e.load(kRegAl, kOffsetDt);
+      e.store(vreg(x), kRegAl);
+      return true;
+    case 0x15:
+      e.load(kRegAl, vreg(x));
+      e.store(kOffsetDt, kRegAl);
+      return true;
+    case 0x18:
+      e.load(kRegAl, vreg(x));
+      e.store(kOffsetSt, kRegAl);
+      return true;
+    case 0x1e:
+      // movzx eax, [vx]; add word [i], ax
+      e.mem({0x0f, 0xb6}, kRegAl, vreg(x));
+      e.mem({0x66, 0x01}, kRegAl, kOffsetI);
+      return true;
+    }
+    return false;
+  }
+
+  return false;
+}
+
+} // namespace
+
+Recompiler::Recompiler() {
+  block_at.fill(-1);
+
+#ifdef ACE_RECOMPILER_X64
+  // never writable and executable at once: blocks are written while the
+  // arena is read/write and flipped to read/exec before they run
+  void *mem = mmap(nullptr, kRecompilerArenaSize, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (mem == MAP_FAILED) {
+    spdlog::error("Failed to allocate recompiler arena: {}",
+                  std::strerror(errno));
+  } else {
+    arena = static_cast<uint8_t *>(mem);
+  }
+#endif
+}
+
+Recompiler::~Recompiler() { release_arena(); }
+
+void Recompiler::release_arena() {
+#ifdef ACE_RECOMPILER_X64
+  if (arena) {
+    munmap(arena, kRecompilerArenaSize);
+    arena = nullptr;
+  }
+#endif
+}
+
+bool Recompiler::protect(size_t offset, size_t len, bool writable) {
+#ifdef ACE_RECOMPILER_X64
+  const size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  size_t start = offset / page * page;
+  size_t end = std::min((offset + len + page - 1) / page * page,
+                        kRecompilerArenaSize);
+  int prot = writable ? PROT_READ | PROT_WRITE : PROT_READ | PROT_EXEC;
+  if (mprotect(arena + start, end - start, prot) != 0) {
+    spdlog::error("Failed to make recompiled code {}: {}",
+                  writable ? "writable" : "executable", std::strerror(errno));
+    return false;
+  }
+  return true;
+#else
+  return false;
+#endif
+}
+
+bool Recompiler::is_usable() const { return arena != nullptr; }
+
+bool Recompiler::is_supported() {
+#ifdef ACE_RECOMPILER_X64
+  return true;
+#else
+  return false;
+#endif
+}
+
+int Recompiler::execute(registers *regs, int budget) {
+  uint16_t pc = regs->pc;
+  if (!arena || pc >= kMemSize - 1) {
+    return 0;
+  }
+
+  int idx = block_at[pc];
+  const block &blk = idx >= 0 ? blocks[idx] : compile(regs, pc);
+
+  if (blk.count == 0 || blk.count > budget) {
+    return 0;
+  }
+
+  blk.func(regs);
+  return blk.count;
+}
+
+void Recompiler::invalidate(uint16_t addr, size_t len) {
+  size_t end = std::min<size_t>(addr + len, kMemSize);
+
+  bool hit = false;
+  for (size_t a = addr; a < end; a += 1) {
+    hit = hit || covered[a];
+  }
+  if (!hit) {
+    return;
+  }
+
+  covered.reset();
+  for (size_t idx = 0; idx < blocks.size(); idx += 1) {
+    const block &blk = blocks[idx];
+    if (block_at[blk.start] != static_cast<int>(idx)) {
+      continue;
+    }
+    if (blk.start < end && addr < blk.end) {
+      spdlog::trace("Invalidating block at {:03x}", blk.start);
+      block_at[blk.start] = -1;
+      continue;
+    }
+    for (int a = blk.start; a < blk.end; a += 1) {
+      covered.set(a);
+    }
+  }
+}
+
+void Recompiler::flush() {
+  spdlog::trace("Flushing recompiled blocks");
+  block_at.fill(-1);
+  blocks.clear();
+  covered.reset();
+  arena_used = 0;
+}
+
+const Recompiler::block &Recompiler::unusable(uint16_t pc) {
+  // the system won't let us run generated code, leave it all to the
+  // interpreter from here on
+  flush();
+  release_arena();
+  block blk;
+  blk.start = pc;
+  blk.end = pc + 2;
+  block_at[pc] = static_cast<int>(blocks.size());
+  blocks.push_back(blk);
+  return blocks.back();
+}
+
+const Recompiler::block &Recompiler::compile(const registers *regs,
+                                             uint16_t pc) {
+  Emitter e;
+  block blk;
+  blk.start = pc;
+
+  uint16_t addr = pc;
+  uint16_t next_pc = pc;
+  while (blk.count < kMaxBlockInstructions && addr < kMemSize - 1) {
+    uint16_t instr = (regs->mem[addr] << 8) | regs->mem[addr + 1];
+
+    if ((instr >> 12) == 0x1) {
+      // jumps end the block with a known target
+      blk.count += 1;
+      addr += 2;
+      next_pc = instr & 0xfff;
+      break;
+    }
+
+    if (!emit_instruction(e, instr)) {
+      break;
+    }
+
+    blk.count += 1;
+    addr += 2;
+    next_pc = addr;
+  }
+
+  // an empty block still remembers that the interpreter handles this address
+  blk.end = blk.count > 0 ? addr : pc + 2;
+
+  if (blk.count > 0) {
+    e.store_imm16(kOffsetPc, next_pc);
+    e.byte(0xc3);
+
+    if (arena_used + e.code.size() > kRecompilerArenaSize ||
+        blocks.size() >= kMaxBlocks) {
+      flush();
+    }
+
+    if (!protect(arena_used, e.code.size(), true)) {
+      return unusable(pc);
+    }
+    uint8_t *code = arena + arena_used;
+    std::memcpy(code, e.code.data(), e.code.size());
+    if (!protect(arena_used, e.code.size(), false)) {
+      return unusable(pc);
+    }
+    arena_used += e.code.size();
+    blk.func = reinterpret_cast<block_func>(code);
+  }
+
+  for (int a = blk.start; a < blk.end && a < kMemSize; a += 1) {
+    covered.set(a);
+  }
+
+  block_at[pc] = static_cast<int>(blocks.size());
+  blocks.push_back(blk);
+  return blocks.back();
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "registers.h"
+
+#include <bitset>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+constexpr size_t kRecompilerArenaSize = 1024 * 1024;
+constexpr int kMaxBlockInstructions = 64;
+
+// Translates straight-line runs of register-only CHIP-8 instructions into
+// native x86-64 code. Anything that touches memory, the screen, the keypad
+// or the stack ends the block and is left to the interpreter.
+class Recompiler {
+public:
+  Recompiler();
+  ~Recompiler();
+
+  Recompiler(const Recompiler &) = delete;
+  Recompiler &operator=(const Recompiler &) = delete;
+
+  static bool is_supported();
+  // false once the code arena couldn't be allocated or made executable
+  bool is_usable() const;
+
+  // Runs the block at regs->pc if it fits in the budget and returns the
+  // number of guest instructions executed, or 0 to fall back to stepping.
+  int execute(registers *regs, int budget);
+
+  void invalidate(uint16_t addr, size_t len);
+  void flush();
+
+private:
+  using block_func = void (*)(registers *regs);
+
+  struct block {
+    block_func func = nullptr;
+    uint16_t start = 0;
+    uint16_t end = 0;
+    int count = 0;
+  };
+
+  const block &compile(const registers *regs, uint16_t pc);
+  const block &unusable(uint16_t pc);
+  bool protect(size_t offset, size_t len, bool writable);
+  void release_arena();
+
+  uint8_t *arena = nullptr;
+  size_t arena_used = 0;
+  std::vector<block> blocks;
+  std::array<int, kMemSize> block_at;
+  std::bitset<kMemSize> covered;
+};
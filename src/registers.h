@@ -2,6 +2,8 @@
 
 #include <algorithm>
 #include <array>
+#include <cstdint>
+#include <memory>
 
 const int kMemSize = 4096;
 const int kGeneralRegisterCount = 16;
@@ -12,10 +14,46 @@ const int kStackStartIndex = 0x10;
 const int kFontStartIndex = 0x50;
 const int kRomStartIndex = 0x200;
 
+// memory is shared between forks a page at a time
+const int kMemPageSize = 256;
+const int kMemPageCount = kMemSize / kMemPageSize;
+
+using memory_page = std::array<uint8_t, kMemPageSize>;
+using memory_page_table =
+    std::array<std::shared_ptr<memory_page>, kMemPageCount>;
+
+const int kFontSpriteHeight = 5;
+
+// hex digits 0-F, loaded at kFontStartIndex
+constexpr std::array<uint8_t, 16 * kFontSpriteHeight> kFontSprites = {
+    0xf0, 0x90, 0x90, 0x90, 0xf0, // 0
+    0x20, 0x60, 0x20, 0x20, 0x70, // 1
+    0xf0, 0x10, 0xf0, 0x80, 0xf0, // 2
+    0xf0, 0x10, 0xf0, 0x10, 0xf0, // 3
+    0x90, 0x90, 0xf0, 0x10, 0x10, // 4
+    0xf0, 0x80, 0xf0, 0x10, 0xf0, // 5
+    0xf0, 0x80, 0xf0, 0x90, 0xf0, // 6
+    0xf0, 0x10, 0x20, 0x40, 0x40, // 7
+    0xf0, 0x90, 0xf0, 0x90, 0xf0, // 8
+    0xf0, 0x90, 0xf0, 0x10, 0xf0, // 9
+    0xf0, 0x90, 0xf0, 0x90, 0x90, // A
+    0xe0, 0x90, 0xe0, 0x90, 0xe0, // B
+    0xf0, 0x80, 0x80, 0x80, 0xf0, // C
+    0xe0, 0x90, 0x90, 0x90, 0xe0, // D
+    0xf0, 0x80, 0xf0, 0x80, 0xf0, // E
+    0xf0, 0x80, 0xf0, 0x80, 0x80, // F
+};
+
 const int kScreenWidth = 64;
 const int kScreenHeight = 32;
 const int kScreenPixelCount = kScreenWidth * kScreenHeight;
 
+// one bit per pixel, the leftmost pixel of a row in the most significant bit
+using screen_row = uint64_t;
+
+static_assert(sizeof(screen_row) * 8 == kScreenWidth,
+              "screen row must hold exactly one line of pixels");
+
 struct registers {
   uint16_t pc = 0;
   uint16_t i = 0;
@@ -24,7 +62,9 @@ struct registers {
   std::array<uint8_t, kGeneralRegisterCount> v{0};
   std::array<uint8_t, kMemSize> mem{0};
   std::array<bool, kKeyboardSize> kbd{false};
-  std::array<bool, kScreenPixelCount> screen{false};
+  std::array<screen_row, kScreenHeight> screen{0};
+  // bumped whenever the contents of screen change
+  uint32_t screen_generation = 0;
 
   inline void reset() {
     pc = 0;
@@ -36,5 +76,15 @@ struct registers {
     std::fill(mem.begin(), mem.end(), 0);
     std::fill(kbd.begin(), kbd.end(), 0);
     std::fill(screen.begin(), screen.end(), 0);
+    screen_generation += 1;
+  }
+
+  inline bool pixel_at(int x, int y) const {
+    return (screen[y] >> (kScreenWidth - 1 - x)) & 1;
+  }
+
+  inline void flip_pixel_at(int x, int y) {
+    screen[y] ^= screen_row{1} << (kScreenWidth - 1 - x);
+    screen_generation += 1;
   }
 };
@@ -0,0 +1,164 @@
+#include "rewind.h"
+
+#include <cstring>
+
+namespace {
+
+constexpr size_t kWordCount = sizeof(save_state) / sizeof(uint64_t);
+
+static_assert(sizeof(save_state) % sizeof(uint64_t) == 0,
+              "save states are diffed a word at a time");
+
+inline uint64_t load_word(const uint8_t *bytes, size_t word) {
+  uint64_t val;
+  std::memcpy(&val, bytes + word * sizeof(uint64_t), sizeof(val));
+  return val;
+}
+
+inline void store_word(uint8_t *bytes, size_t word, uint64_t val) {
+  std::memcpy(bytes + word * sizeof(uint64_t), &val, sizeof(val));
+}
+
+inline void append_u16(std::vector<uint8_t> &out, uint16_t val) {
+  out.push_back(val & 0xff);
+  out.push_back(val >> 8);
+}
+
+inline uint16_t read_u16(const uint8_t *bytes) {
+  return bytes[0] | (bytes[1] << 8);
+}
+
+} // namespace
+
+RewindBuffer::RewindBuffer(size_t capacity) : ring(capacity) {
+  // worst case every word differs: one run header plus all the words
+  scratch.reserve(2 * sizeof(uint16_t) + sizeof(save_state));
+}
+
+void RewindBuffer::clear() {
+  entries.clear();
+  used = 0;
+  has_head = false;
+}
+
+void RewindBuffer::push(const save_state &state) {
+  if (!has_head) {
+    head = state;
+    has_head = true;
+    return;
+  }
+
+  encode(state);
+  store();
+}
+
+bool RewindBuffer::drop_latest() {
+  if (entries.empty()) {
+    return false;
+  }
+
+  const entry &delta = entries.back();
+  uint8_t *bytes = reinterpret_cast<uint8_t *>(&head);
+  const uint8_t *pos = ring.data() + delta.offset;
+  const uint8_t *end = pos + delta.size;
+
+  size_t word = 0;
+  while (pos < end) {
+    word += read_u16(pos);
+    size_t count = read_u16(pos + 2);
+    pos += 4;
+    for (size_t idx = 0; idx < count; idx += 1, word += 1) {
+      uint64_t val;
+      std::memcpy(&val, pos, sizeof(val));
+      store_word(bytes, word, load_word(bytes, word) ^ val);
+      pos += sizeof(val);
+    }
+  }
+
+  used -= delta.size;
+  entries.pop_back();
+  return true;
+}
+
+bool RewindBuffer::empty() const { return !has_head; }
+
+const save_state &RewindBuffer::latest() const { return head; }
+
+uint64_t RewindBuffer::latest_cycle() const { return head.interpreter.cycle(); }
+
+size_t RewindBuffer::size() const { return entries.size() + has_head; }
+
+size_t RewindBuffer::bytes_used() const {
+  return used + (has_head ? sizeof(save_state) : 0);
+}
+
+// Writes runs of (words skipped, words changed, XOR of each changed word)
+// to scratch and moves head forward to state on the way.
+void RewindBuffer::encode(const save_state &state) {
+  uint8_t *prev = reinterpret_cast<uint8_t *>(&head);
+  const uint8_t *next = reinterpret_cast<const uint8_t *>(&state);
+
+  scratch.clear();
+  size_t word = 0;
+  while (word < kWordCount) {
+    size_t start = word;
+    while (word < kWordCount &&
+           load_word(prev, word) == load_word(next, word)) {
+      word += 1;
+    }
+    if (word == kWordCount) {
+      break;
+    }
+
+    size_t run = word;
+    while (word < kWordCount &&
+           load_word(prev, word) != load_word(next, word)) {
+      word += 1;
+    }
+
+    append_u16(scratch, static_cast<uint16_t>(run - start));
+    append_u16(scratch, static_cast<uint16_t>(word - run));
+    for (size_t idx = run; idx < word; idx += 1) {
+      uint64_t a = load_word(prev, idx);
+      uint64_t b = load_word(next, idx);
+      uint64_t delta = a ^ b;
+      const uint8_t *delta_bytes = reinterpret_cast<const uint8_t *>(&delta);
+      scratch.insert(scratch.end(), delta_bytes, delta_bytes + sizeof(delta));
+      store_word(prev, idx, b);
+    }
+  }
+}
+
+void RewindBuffer::store() {
+  size_t size = scratch.size();
+  if (size > ring.size()) {
+    // can't happen with a sane capacity, history just starts over
+    entries.clear();
+    used = 0;
+    return;
+  }
+
+  size_t offset = 0;
+  if (!entries.empty()) {
+    offset = entries.back().offset + entries.back().size;
+  }
+  if (offset + size > ring.size()) {
+    // the space left at the end of the ring holds only the oldest deltas
+    while (!entries.empty() && entries.front().offset >= offset) {
+      used -= entries.front().size;
+      entries.pop_front();
+    }
+    offset = 0;
+  }
+
+  // anything still in the way is the oldest history
+  while (!entries.empty() && entries.front().offset >= offset &&
+         entries.front().offset < offset + size) {
+    used -= entries.front().size;
+    entries.pop_front();
+  }
+
+  std::memcpy(ring.data() + offset, scratch.data(), size);
+  entries.push_back({offset, size});
+  used += size;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "save_state.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+constexpr size_t kRewindBufferSize = 4 * 1024 * 1024;
+// snapshots per host second at most, fast-forwarded frames share them
+constexpr int kRewindCaptureRate = 120;
+
+// History of machine states, newest first. Only the latest state is kept in
+// full; every older one is stored as the XOR of itself and its successor,
+// run-length encoded over the 8-byte words that differ. Going back a state
+// applies the newest delta to the latest state and forgets that delta.
+// Deltas live in one fixed ring of bytes, the oldest make way for new ones.
+class RewindBuffer {
+public:
+  explicit RewindBuffer(size_t capacity = kRewindBufferSize);
+
+  void clear();
+  void push(const save_state &state);
+  // steps the latest state back to the one before it, false if there is none
+  bool drop_latest();
+
+  bool empty() const;
+  const save_state &latest() const;
+  uint64_t latest_cycle() const;
+
+  // states kept, including the latest
+  size_t size() const;
+  size_t bytes_used() const;
+
+private:
+  struct entry {
+    size_t offset = 0;
+    size_t size = 0;
+  };
+
+  void encode(const save_state &state);
+  void store();
+
+  std::vector<uint8_t> ring;
+  std::deque<entry> entries;
+  size_t used = 0;
+
+  save_state head{};
+  bool has_head = false;
+  // the newest delta before it's copied into the ring
+  std::vector<uint8_t> scratch;
+};
@@ -0,0 +1,172 @@
+#include "save_state.h"
+
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <spdlog/spdlog.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+void save_state::stamp() {
+  header.magic = kSaveStateMagic;
+  header.version = kSaveStateVersion;
+  header.size = sizeof(save_state);
+  header.reserved = 0;
+}
+
+bool save_state::is_valid() const {
+  return header.magic == kSaveStateMagic &&
+         header.version == kSaveStateVersion &&
+         header.size == sizeof(save_state);
+}
+
+SaveSlotFile::~SaveSlotFile() { close(); }
+
+#ifndef _WIN32
+
+bool SaveSlotFile::open(const std::string &filename, bool create) {
+  close();
+
+  fd = ::open(filename.c_str(), create ? O_RDWR | O_CREAT : O_RDWR, 0644);
+  if (fd < 0) {
+    if (!create && errno == ENOENT) {
+      spdlog::debug("No save state file {}", filename);
+    } else {
+      spdlog::error("Failed to open save state file {}: {}", filename,
+                    std::strerror(errno));
+    }
+    return false;
+  }
+
+  struct stat info;
+  if (fstat(fd, &info) != 0) {
+    spdlog::error("Failed to stat save state file {}: {}", filename,
+                  std::strerror(errno));
+    close();
+    return false;
+  }
+  if (info.st_size != sizeof(save_state)) {
+    // new file, or one from a build with a different layout, only a save
+    // may overwrite it
+    if (!create) {
+      spdlog::warn("Save state file {} is from another version", filename);
+      close();
+      return false;
+    }
+    if (ftruncate(fd, sizeof(save_state)) != 0) {
+      spdlog::error("Failed to size save state file {}: {}", filename,
+                    std::strerror(errno));
+      close();
+      return false;
+    }
+  }
+
+  void *mem = mmap(nullptr, sizeof(save_state), PROT_READ | PROT_WRITE,
+                   MAP_SHARED, fd, 0);
+  if (mem == MAP_FAILED) {
+    spdlog::error("Failed to map save state file {}: {}", filename,
+                  std::strerror(errno));
+    close();
+    return false;
+  }
+
+  path = filename;
+  mapped = static_cast<save_state *>(mem);
+  return true;
+}
+
+void SaveSlotFile::close() {
+  if (mapped) {
+    munmap(mapped, sizeof(save_state));
+    mapped = nullptr;
+  }
+  if (fd >= 0) {
+    ::close(fd);
+    fd = -1;
+  }
+  path.clear();
+}
+
+bool SaveSlotFile::is_open() const { return mapped != nullptr; }
+
+bool SaveSlotFile::write(const save_state &state) {
+  if (!mapped) {
+    return false;
+  }
+  std::memcpy(mapped, &state, sizeof(save_state));
+  // let the kernel write it back in its own time
+  msync(mapped, sizeof(save_state), MS_ASYNC);
+  return true;
+}
+
+bool SaveSlotFile::read(save_state &state) const {
+  if (!mapped || !mapped->is_valid()) {
+    return false;
+  }
+  std::memcpy(&state, mapped, sizeof(save_state));
+  return true;
+}
+
+#else
+
+// no mapping here, the file is still read and written as a single block
+
+bool SaveSlotFile::open(const std::string &filename, bool create) {
+  close();
+
+  if (!create) {
+    std::ifstream existing(filename, std::ios::binary | std::ios::ate);
+    if (!existing) {
+      return false;
+    }
+    if (existing.tellg() != static_cast<std::streamoff>(sizeof(save_state))) {
+      spdlog::warn("Save state file {} is from another version", filename);
+      return false;
+    }
+    path = filename;
+    return true;
+  }
+
+  std::ofstream touch(filename, std::ios::binary | std::ios::app);
+  if (!touch) {
+    spdlog::error("Failed to open save state file {}", filename);
+    return false;
+  }
+
+  path = filename;
+  return true;
+}
+
+void SaveSlotFile::close() { path.clear(); }
+
+bool SaveSlotFile::is_open() const { return !path.empty(); }
+
+bool SaveSlotFile::write(const save_state &state) {
+  if (path.empty()) {
+    return false;
+  }
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  out.write(reinterpret_cast<const char *>(&state), sizeof(save_state));
+  return static_cast<bool>(out);
+}
+
+bool SaveSlotFile::read(save_state &state) const {
+  if (path.empty()) {
+    return false;
+  }
+  save_state loaded;
+  std::ifstream in(path, std::ios::binary);
+  in.read(reinterpret_cast<char *>(&loaded), sizeof(save_state));
+  if (in.gcount() != sizeof(save_state) || !loaded.is_valid()) {
+    return false;
+  }
+  state = loaded;
+  return true;
+}
+
+#endif
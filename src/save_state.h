@@ -0,0 +1,66 @@
+#pragma once
+
+#include "interpreter.h"
+#include "registers.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <type_traits>
+
+// "ACE8" read as a little-endian word
+constexpr uint32_t kSaveStateMagic = 0x38454341;
+constexpr uint32_t kSaveStateVersion = 3;
+constexpr int kSaveSlotCount = 10;
+
+struct save_state_header {
+  uint32_t magic = 0;
+  uint32_t version = 0;
+  // sizeof(save_state) when written, catches layout changes between builds
+  uint32_t size = 0;
+  uint32_t reserved = 0;
+};
+
+// The whole machine as one flat block. Saving and loading are plain copies,
+// and the on-disk format is this struct byte for byte, so states only load
+// into builds with the same version and layout.
+struct save_state {
+  save_state_header header;
+  registers regs;
+  interpreter_state interpreter;
+
+  void stamp();
+  bool is_valid() const;
+};
+
+static_assert(std::is_trivially_copyable_v<save_state>,
+              "save states are copied with memcpy");
+
+// A save slot backed by a file. The file is mapped into memory where the
+// platform allows it, so saving and loading are copies into and out of the
+// page cache with nothing to parse.
+class SaveSlotFile {
+public:
+  SaveSlotFile() = default;
+  ~SaveSlotFile();
+
+  SaveSlotFile(const SaveSlotFile &) = delete;
+  SaveSlotFile &operator=(const SaveSlotFile &) = delete;
+
+  // Only a save creates the file or resizes one from another layout. Opening
+  // to load leaves a missing or mismatched file alone and fails.
+  bool open(const std::string &path, bool create);
+  void close();
+  bool is_open() const;
+
+  bool write(const save_state &state);
+  // false if the file holds no state or one from another version
+  bool read(save_state &state) const;
+
+private:
+  std::string path;
+  save_state *mapped = nullptr;
+#ifndef _WIN32
+  int fd = -1;
+#endif
+};
@@ -1,35 +1,70 @@
 #include "screen.h"
 
+#include <algorithm>
+#include <imgui.h>
 #include <rlImGui.h>
 #include <spdlog/spdlog.h>
 
-void Screen::initialize(int width, int height, int pixel_size_,
-                        const bool pixels_[]) {
-  spdlog::debug("Initializing screen {}x{}", width, height);
-  screen_width = width;
-  screen_height = height;
-  pixel_size = pixel_size_;
-  pixels = pixels_;
-  screen_texture =
-      LoadRenderTexture(screen_width * pixel_size, screen_height * pixel_size);
+void rasterize_screen(const registers &regs, Color *pixels) {
+  for (int y = 0; y < kScreenHeight; y += 1) {
+    screen_row row = regs.screen[y];
+    Color *line = &pixels[y * kScreenWidth];
+    for (int x = 0; x < kScreenWidth; x += 1) {
+      bool px = (row >> (kScreenWidth - 1 - x)) & 1;
+      line[x] = px ? RAYWHITE : BLACK;
+    }
+  }
+}
+
+void Screen::initialize(const registers *regs_) {
+  spdlog::debug("Initializing screen {}x{}", kScreenWidth, kScreenHeight);
+  regs = regs_;
+  needs_upload = true;
+  pixels.assign(kScreenPixelCount, BLACK);
+
+  Image image = GenImageColor(kScreenWidth, kScreenHeight, BLACK);
+  screen_texture = LoadTextureFromImage(image);
+  UnloadImage(image);
+
+  SetTextureFilter(screen_texture, TEXTURE_FILTER_POINT);
 }
 
 void Screen::update() {
-  BeginTextureMode(screen_texture);
-  for (int y = 0; y < screen_height; y += 1) {
-    for (int x = 0; x < screen_width; x += 1) {
-      int idx = (y * screen_width) + x;
-      bool px = pixels[idx];
-      DrawRectangle(x * pixel_size, y * pixel_size, pixel_size, pixel_size,
-                    px ? RAYWHITE : BLACK);
-    }
+  if (!needs_upload && regs->screen_generation == presented_generation) {
+    skipped_frames += 1;
+    return;
   }
-  EndTextureMode();
+
+  rasterize_screen(*regs, pixels.data());
+  UpdateTexture(screen_texture, pixels.data());
+
+  presented_generation = regs->screen_generation;
+  needs_upload = false;
+  presented_frames += 1;
 }
 
-void Screen::draw() { rlImGuiImageRenderTextureFit(&screen_texture, true); }
+void Screen::draw() {
+  ImVec2 area = ImGui::GetContentRegionAvail();
+  float scale = std::min(area.x / static_cast<float>(kScreenWidth),
+                         area.y / static_cast<float>(kScreenHeight));
+  if (scale <= 0.0f) {
+    return;
+  }
+
+  ImVec2 size{kScreenWidth * scale, kScreenHeight * scale};
+  ImVec2 cursor = ImGui::GetCursorPos();
+  ImGui::SetCursorPos({cursor.x + (area.x - size.x) / 2,
+                       cursor.y + (area.y - size.y) / 2});
+
+  rlImGuiImageSize(&screen_texture, static_cast<int>(size.x),
+                   static_cast<int>(size.y));
+}
+
+uint64_t Screen::get_presented_frames() const { return presented_frames; }
+
+uint64_t Screen::get_skipped_frames() const { return skipped_frames; }
 
 void Screen::cleanup() {
   spdlog::debug("Cleaning up screen");
-  UnloadRenderTexture(screen_texture);
+  UnloadTexture(screen_texture);
 }
@@ -1,16 +1,31 @@
 #pragma once
 
+#include "registers.h"
+
+#include <cstdint>
 #include <raylib.h>
+#include <vector>
+
+// Converts the bit-packed screen into texture pixels, the part of
+// Screen::update() that doesn't need a GPU.
+void rasterize_screen(const registers &regs, Color *pixels);
 
 class Screen {
 public:
-  void initialize(int width, int height, int pixel_size, const bool pixels[]);
+  void initialize(const registers *regs);
   void update();
   void draw();
   void cleanup();
 
+  uint64_t get_presented_frames() const;
+  uint64_t get_skipped_frames() const;
+
 private:
-  RenderTexture2D screen_texture;
-  const bool *pixels = nullptr;
-  int screen_width = 0, screen_height = 0, pixel_size = 0;
+  Texture2D screen_texture;
+  std::vector<Color> pixels;
+  const registers *regs = nullptr;
+  uint32_t presented_generation = 0;
+  bool needs_upload = true;
+  uint64_t presented_frames = 0;
+  uint64_t skipped_frames = 0;
 };
@@ -0,0 +1,180 @@
+#include "shared_state.h"
+
+#include <cerrno>
+#include <cstring>
+#include <new>
+#include <spdlog/spdlog.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// gives up on a reader that keeps catching the writer mid-update
+constexpr int kSharedStateReadAttempts = 64;
+
+bool read_shared_state(const shared_state_block &block,
+                       shared_state_data &out) {
+  if (block.magic != kSharedStateMagic ||
+      block.version != kSharedStateVersion ||
+      block.size != sizeof(shared_state_block)) {
+    return false;
+  }
+
+  for (int attempt = 0; attempt < kSharedStateReadAttempts; attempt += 1) {
+    uint32_t before = block.sequence.load(std::memory_order_acquire);
+    if (before & 1) {
+      continue;
+    }
+    std::memcpy(&out, &block.data, sizeof(out));
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (block.sequence.load(std::memory_order_relaxed) == before) {
+      return true;
+    }
+  }
+  return false;
+}
+
+SharedStateExport::~SharedStateExport() { close(); }
+
+bool SharedStateExport::is_open() const { return block != nullptr; }
+
+void SharedStateExport::publish(const registers &regs, uint64_t cycle,
+                                uint64_t frames, bool playing) {
+  if (!block) {
+    return;
+  }
+
+  uint32_t sequence = block->sequence.load(std::memory_order_relaxed);
+  block->sequence.store(sequence + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  shared_state_data &data = block->data;
+  data.cycle = cycle;
+  data.frames = frames;
+  data.pc = regs.pc;
+  data.i = regs.i;
+  data.dt = regs.dt;
+  data.st = regs.st;
+  data.playing = playing;
+  data.v = regs.v;
+  uint16_t keys = 0;
+  for (int key = 0; key < kKeyboardSize; key += 1) {
+    keys |= static_cast<uint16_t>(regs.kbd[key]) << key;
+  }
+  data.keys = keys;
+  // the screen only changes on CLS and DRW, skip it when readers have it
+  if (data.screen_generation != regs.screen_generation) {
+    data.screen_generation = regs.screen_generation;
+    data.screen = regs.screen;
+  }
+
+  block->sequence.store(sequence + 2, std::memory_order_release);
+}
+
+uint32_t SharedStateExport::read_input() const {
+  return block ? block->input.load(std::memory_order_relaxed) : 0;
+}
+
+#ifndef _WIN32
+
+bool SharedStateExport::open(const std::string &name_) {
+  close();
+
+  std::string shm_name = name_.empty() || name_[0] != '/' ? "/" + name_
+                                                          : name_;
+  bool created = true;
+  int fd = shm_open(shm_name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+  if (fd < 0 && errno == EEXIST) {
+    // left behind by a run that didn't get to close it, or still in use
+    created = false;
+    fd = shm_open(shm_name.c_str(), O_RDWR, 0600);
+  }
+  if (fd < 0) {
+    spdlog::error("Failed to open shared memory {}: {}", shm_name,
+                  std::strerror(errno));
+    return false;
+  }
+
+  // only a segment we made is ours to remove when something goes wrong
+  auto fail = [&](const char *what) {
+    spdlog::error("Failed to {} shared memory {}: {}", what, shm_name,
+                  std::strerror(errno));
+    ::close(fd);
+    if (created) {
+      shm_unlink(shm_name.c_str());
+    }
+    return false;
+  };
+
+  struct stat info {};
+  if (fstat(fd, &info) != 0) {
+    return fail("inspect");
+  }
+  // one too short to hold a magic was never published to
+  bool in_use = false;
+  if (!created && info.st_size >= static_cast<off_t>(sizeof(uint32_t))) {
+    void *head = mmap(nullptr, sizeof(uint32_t), PROT_READ, MAP_SHARED, fd, 0);
+    if (head == MAP_FAILED) {
+      return fail("map");
+    }
+    // close() clears the magic, anything else still holds the segment
+    in_use = *static_cast<const volatile uint32_t *>(head) != 0;
+    munmap(head, sizeof(uint32_t));
+  }
+  if (in_use) {
+    ::close(fd);
+    spdlog::error("Shared memory {} is in use by another process, pick "
+                  "another name",
+                  shm_name);
+    return false;
+  }
+
+  if (ftruncate(fd, sizeof(shared_state_block)) != 0) {
+    return fail("size");
+  }
+
+  void *mem = mmap(nullptr, sizeof(shared_state_block), PROT_READ | PROT_WRITE,
+                   MAP_SHARED, fd, 0);
+  if (mem == MAP_FAILED) {
+    return fail("map");
+  }
+  // the mapping keeps the segment alive on its own
+  ::close(fd);
+
+  // a reclaimed segment starts over, readers see the new magic only once
+  // the rest is in place
+  block = new (mem) shared_state_block();
+  block->version = kSharedStateVersion;
+  block->size = sizeof(shared_state_block);
+  std::atomic_thread_fence(std::memory_order_release);
+  block->magic = kSharedStateMagic;
+
+  name = shm_name;
+  spdlog::info("Publishing machine state to shared memory {}", name);
+  return true;
+}
+
+void SharedStateExport::close() {
+  if (!block) {
+    return;
+  }
+  block->magic = 0;
+  munmap(block, sizeof(shared_state_block));
+  block = nullptr;
+  shm_unlink(name.c_str());
+  name.clear();
+}
+
+#else
+
+bool SharedStateExport::open(const std::string &name_) {
+  spdlog::error("Shared memory export is not supported on this platform");
+  return false;
+}
+
+void SharedStateExport::close() {}
+
+#endif
@@ -0,0 +1,90 @@
+#pragma once
+
+#include "registers.h"
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <type_traits>
+
+// "AC8S" read as a little-endian word
+constexpr uint32_t kSharedStateMagic = 0x53384341;
+constexpr uint32_t kSharedStateVersion = 1;
+
+// What the emulator publishes, a plain block copied in and out whole.
+struct shared_state_data {
+  // instruction slots since reset and guest frames run
+  uint64_t cycle = 0;
+  uint64_t frames = 0;
+  uint16_t pc = 0;
+  uint16_t i = 0;
+  uint8_t dt = 0;
+  uint8_t st = 0;
+  uint8_t playing = 0;
+  uint8_t reserved = 0;
+  std::array<uint8_t, kGeneralRegisterCount> v{0};
+  // key n in bit n
+  uint16_t keys = 0;
+  uint16_t reserved_keys = 0;
+  uint32_t screen_generation = 0;
+  std::array<screen_row, kScreenHeight> screen{0};
+};
+
+// Layout of the shared-memory segment. Other processes map it to read the
+// machine without going through the UI.
+//
+// The data is guarded by a seqlock: sequence is odd while the emulator is
+// writing, so readers copy the data between two loads of an even, unchanged
+// sequence and retry otherwise. read_shared_state() does exactly that.
+//
+// Tools press keys by storing to input: bit n + 16 claims key n, bit n then
+// holds it down. The emulator samples it at every frame boundary, claimed
+// keys override the UI's and unclaimed ones are left alone.
+struct shared_state_block {
+  uint32_t magic = 0;
+  uint32_t version = 0;
+  // sizeof(shared_state_block) of the writer
+  uint32_t size = 0;
+  std::atomic<uint32_t> sequence{0};
+  std::atomic<uint32_t> input{0};
+  uint32_t reserved = 0;
+  shared_state_data data;
+};
+
+static_assert(std::is_trivially_copyable_v<shared_state_data>,
+              "shared state is copied with memcpy");
+static_assert(std::atomic<uint32_t>::is_always_lock_free,
+              "atomics in shared memory must not need a lock");
+
+// Copies a consistent snapshot out of a mapped block. False if the block
+// isn't a shared state of this version or the writer kept it busy.
+bool read_shared_state(const shared_state_block &block,
+                       shared_state_data &out);
+
+// The emulator's end of the segment. Publishing is a copy of a few hundred
+// bytes into memory the emulator already owns, with no system calls.
+class SharedStateExport {
+public:
+  SharedStateExport() = default;
+  ~SharedStateExport();
+
+  SharedStateExport(const SharedStateExport &) = delete;
+  SharedStateExport &operator=(const SharedStateExport &) = delete;
+
+  // creates the segment, a POSIX shared memory name like "/ace-chip8".
+  // Fails rather than take over one another process is publishing to.
+  bool open(const std::string &name);
+  // unmaps and removes the segment
+  void close();
+  bool is_open() const;
+
+  void publish(const registers &regs, uint64_t cycle, uint64_t frames,
+               bool playing);
+  // keys claimed by tools in the high half, their state in the low half
+  uint32_t read_input() const;
+
+private:
+  std::string name;
+  shared_state_block *block = nullptr;
+};
@@ -50,6 +50,14 @@ std::vector<std::pair<const char*, std::function<float(double)>>> wave_funcs = {
   std::make_pair("Noise", noise),
 };
 
+int wave_type_count() { return static_cast<int>(wave_funcs.size()); }
+
+const char* wave_type_name(int type) { return wave_funcs[type].first; }
+
+void WaveGeneratorSource::set_wave_type(int type) {
+  wave_type = std::clamp(type, 0, wave_type_count() - 1);
+}
+
 void WaveGeneratorSource::render() {
   if (ImGui::BeginCombo("Type", wave_funcs[wave_type].first)) {
     for (int n = 0; n < wave_funcs.size(); n += 1) {
@@ -320,6 +328,11 @@ void SoundManager::update(bool play_sound) {
     return;
   }
 
+  mix(play_sound);
+  UpdateAudioStream(stream, buffer.data(), buffer.size());
+}
+
+void SoundManager::mix(bool play_sound) {
   memset(samples.data(), 0, samples.size() * sizeof(float));
 
   for (auto &pair : sources) {
@@ -335,10 +348,10 @@ void SoundManager::update(bool play_sound) {
   }
 
   time = fmod(time + (1.0 / kAudioSampleRate) * buffer.size(), 1.0);
-
-  UpdateAudioStream(stream, buffer.data(), buffer.size());
 }
 
+const short* SoundManager::get_buffer() const { return buffer.data(); }
+
 void SoundManager::add_source(std::unique_ptr<SoundSource> source) {
   sources.push_back(sound_source_pair {
     std::move(source),
@@ -27,6 +27,9 @@ protected:
   std::array<float, kMaxSamplesPerUpdate> samples;
 };
 
+int wave_type_count();
+const char* wave_type_name(int type);
+
 class WaveGeneratorSource final : public SoundSource {
 public:
   virtual ~WaveGeneratorSource() = default;
@@ -35,6 +38,8 @@ public:
   virtual void render() override;
   virtual void update(bool play_sound, double time) override;
 
+  void set_wave_type(int type);
+
 private:
   bool force_play = false;
   float frequency = 440.0f;
@@ -74,6 +79,11 @@ public:
   void update(bool play_sound);
   void cleanup();
 
+  // mixes every source into the next buffer, the part of update() that
+  // doesn't need an audio device
+  void mix(bool play_sound);
+  const short* get_buffer() const;
+
   void add_source(std::unique_ptr<SoundSource> source);
   void remove_source_at(size_t index);
 
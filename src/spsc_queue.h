@@ -0,0 +1,46 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <optional>
+#include <utility>
+
+// Bounded single-producer/single-consumer queue. push() must only be called
+// from one thread and pop() from one other thread.
+template <typename T, size_t Capacity>
+class SpscQueue {
+  static_assert((Capacity & (Capacity - 1)) == 0,
+                "capacity must be a power of two");
+
+public:
+  bool push(T value) {
+    size_t t = tail.load(std::memory_order_relaxed);
+    if (t - head.load(std::memory_order_acquire) == Capacity) {
+      return false;
+    }
+    slots[t & (Capacity - 1)] = std::move(value);
+    tail.store(t + 1, std::memory_order_release);
+    return true;
+  }
+
+  std::optional<T> pop() {
+    size_t h = head.load(std::memory_order_relaxed);
+    if (h == tail.load(std::memory_order_acquire)) {
+      return std::nullopt;
+    }
+    T value = std::move(slots[h & (Capacity - 1)]);
+    head.store(h + 1, std::memory_order_release);
+    return value;
+  }
+
+  bool empty() const {
+    return head.load(std::memory_order_acquire) ==
+           tail.load(std::memory_order_acquire);
+  }
+
+private:
+  std::array<T, Capacity> slots;
+  alignas(64) std::atomic<size_t> head{0};
+  alignas(64) std::atomic<size_t> tail{0};
+};
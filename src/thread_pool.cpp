@@ -0,0 +1,122 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <exception>
+#include <spdlog/spdlog.h>
+
+namespace {
+
+// set on worker threads, lets submit() find the caller's own deque
+thread_local const WorkStealingPool *current_pool = nullptr;
+thread_local unsigned current_worker = 0;
+
+} // namespace
+
+WorkStealingPool::WorkStealingPool(unsigned thread_count) {
+  if (thread_count == 0) {
+    thread_count = std::max(std::thread::hardware_concurrency(), 1u);
+  }
+
+  for (unsigned idx = 0; idx < thread_count; idx += 1) {
+    queues.push_back(std::make_unique<task_queue>());
+  }
+  for (unsigned idx = 0; idx < thread_count; idx += 1) {
+    threads.emplace_back(&WorkStealingPool::work, this, idx);
+  }
+}
+
+WorkStealingPool::~WorkStealingPool() {
+  wait();
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  work_available.notify_all();
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+}
+
+void WorkStealingPool::submit(std::function<void()> task) {
+  unsigned index = current_pool == this
+                       ? current_worker
+                       : next_queue.fetch_add(1) % queues.size();
+  {
+    std::lock_guard<std::mutex> lock(queues[index]->mutex);
+    queues[index]->tasks.push_back(std::move(task));
+  }
+  {
+    // counted under the lock so a worker about to sleep can't miss it
+    std::lock_guard<std::mutex> lock(mutex);
+    queued += 1;
+    pending += 1;
+  }
+  work_available.notify_one();
+}
+
+void WorkStealingPool::wait() {
+  std::unique_lock<std::mutex> lock(mutex);
+  all_done.wait(lock, [this] { return pending == 0; });
+}
+
+unsigned WorkStealingPool::size() const { return threads.size(); }
+
+void WorkStealingPool::work(unsigned index) {
+  current_pool = this;
+  current_worker = index;
+
+  std::function<void()> task;
+  while (true) {
+    if (pop(index, task) || steal(index, task)) {
+      try {
+        task();
+      } catch (const std::exception &err) {
+        spdlog::error("Task failed: {}", err.what());
+      }
+      task = nullptr;
+      finish();
+      continue;
+    }
+
+    std::unique_lock<std::mutex> lock(mutex);
+    work_available.wait(lock, [this] { return stopping || queued > 0; });
+    if (stopping && queued == 0) {
+      return;
+    }
+  }
+}
+
+bool WorkStealingPool::pop(unsigned index, std::function<void()> &task) {
+  task_queue &queue = *queues[index];
+  std::lock_guard<std::mutex> lock(queue.mutex);
+  if (queue.tasks.empty()) {
+    return false;
+  }
+  task = std::move(queue.tasks.back());
+  queue.tasks.pop_back();
+  queued -= 1;
+  return true;
+}
+
+bool WorkStealingPool::steal(unsigned index, std::function<void()> &task) {
+  for (size_t offset = 1; offset < queues.size(); offset += 1) {
+    task_queue &victim = *queues[(index + offset) % queues.size()];
+    std::lock_guard<std::mutex> lock(victim.mutex);
+    if (victim.tasks.empty()) {
+      continue;
+    }
+    task = std::move(victim.tasks.front());
+    victim.tasks.pop_front();
+    queued -= 1;
+    return true;
+  }
+  return false;
+}
+
+void WorkStealingPool::finish() {
+  std::lock_guard<std::mutex> lock(mutex);
+  pending -= 1;
+  if (pending == 0) {
+    all_done.notify_all();
+  }
+}
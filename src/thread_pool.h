@@ -0,0 +1,57 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of workers, each with its own task deque. A worker takes its
+// newest task first and, once out of work, steals the oldest task of another
+// worker, so uneven jobs spread out without one shared queue to fight over.
+class WorkStealingPool {
+public:
+  // zero threads means one per hardware thread
+  explicit WorkStealingPool(unsigned thread_count = 0);
+  ~WorkStealingPool();
+
+  WorkStealingPool(const WorkStealingPool &) = delete;
+  WorkStealingPool &operator=(const WorkStealingPool &) = delete;
+
+  // Tasks submitted from a worker go to that worker's deque, others are
+  // dealt round-robin.
+  void submit(std::function<void()> task);
+  // blocks until every submitted task has finished
+  void wait();
+
+  unsigned size() const;
+
+private:
+  struct task_queue {
+    std::mutex mutex;
+    std::deque<std::function<void()>> tasks;
+  };
+
+  void work(unsigned index);
+  bool pop(unsigned index, std::function<void()> &task);
+  bool steal(unsigned index, std::function<void()> &task);
+  void finish();
+
+  std::vector<std::unique_ptr<task_queue>> queues;
+  std::vector<std::thread> threads;
+
+  // guards pending and stopping, and the sleeps on both condition variables
+  std::mutex mutex;
+  std::condition_variable work_available;
+  std::condition_variable all_done;
+  // tasks sitting in a deque
+  std::atomic<size_t> queued{0};
+  // queued or running
+  size_t pending = 0;
+  bool stopping = false;
+  std::atomic<unsigned> next_queue{0};
+};
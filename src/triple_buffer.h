@@ -0,0 +1,38 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+// Lock-free triple buffer: one writer publishes whole values, one reader
+// always gets the most recently published one without ever blocking.
+template <typename T>
+class TripleBuffer {
+public:
+  // writer side
+  T &write_buffer() { return buffers[write_index]; }
+
+  void publish() {
+    uint8_t prev = shared.exchange(write_index | kFreshBit,
+                                   std::memory_order_acq_rel);
+    write_index = prev & kIndexMask;
+  }
+
+  // reader side
+  const T &read() {
+    if (shared.load(std::memory_order_relaxed) & kFreshBit) {
+      uint8_t prev = shared.exchange(read_index, std::memory_order_acq_rel);
+      read_index = prev & kIndexMask;
+    }
+    return buffers[read_index];
+  }
+
+private:
+  static constexpr uint8_t kFreshBit = 0x4;
+  static constexpr uint8_t kIndexMask = 0x3;
+
+  std::array<T, 3> buffers{};
+  std::atomic<uint8_t> shared{1};
+  uint8_t write_index = 0;
+  uint8_t read_index = 2;
+};